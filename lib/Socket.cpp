@@ -25,6 +25,7 @@
 #include "Socket.h"
 
 #include <iostream>
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 #include <cerrno>
@@ -127,6 +128,65 @@ void UDPSocket::setBlocking(bool block)
     }
 }
 
+bool UDPSocket::enableTimestamps()
+{
+#if defined(SO_TIMESTAMPNS)
+    const int option = SO_TIMESTAMPNS;
+#elif defined(SO_TIMESTAMP)
+    const int option = SO_TIMESTAMP;
+#else
+    return false;
+#endif
+
+#if defined(SO_TIMESTAMPNS) || defined(SO_TIMESTAMP)
+    const int enable = 1;
+    // Packets then get the time they were read from the socket instead
+    return setsockopt(m_sock, SOL_SOCKET, option, &enable, sizeof(enable)) != SOCKET_ERROR;
+#endif
+}
+
+/* Space for the control message carrying the receive timestamp */
+union TimestampControl {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(std::max(sizeof(struct timespec), sizeof(struct timeval)))];
+};
+
+/* Extract the kernel receive timestamp from the control messages, and
+ * fall back to now if there is none. */
+static chrono::system_clock::time_point receiveTimestamp(
+        struct msghdr& msg,
+        const chrono::system_clock::time_point& now)
+{
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg != nullptr;
+            cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET) {
+            continue;
+        }
+
+#if defined(SCM_TIMESTAMPNS)
+        if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            return chrono::system_clock::time_point(
+                    chrono::duration_cast<chrono::system_clock::duration>(
+                        chrono::seconds(ts.tv_sec) + chrono::nanoseconds(ts.tv_nsec)));
+        }
+#endif
+#if defined(SCM_TIMESTAMP)
+        if (cmsg->cmsg_type == SCM_TIMESTAMP) {
+            struct timeval tv;
+            memcpy(&tv, CMSG_DATA(cmsg), sizeof(tv));
+            return chrono::system_clock::time_point(
+                    chrono::duration_cast<chrono::system_clock::duration>(
+                        chrono::seconds(tv.tv_sec) + chrono::microseconds(tv.tv_usec)));
+        }
+#endif
+    }
+
+    return now;
+}
+
 void UDPSocket::reinit(int port)
 {
     return reinit(port, "");
@@ -213,18 +273,68 @@ UDPSocket::~UDPSocket()
 UDPPacket UDPSocket::receive(size_t max_size)
 {
     UDPPacket packet(max_size);
+    const size_t len = receive(packet.buffer.data(), packet.buffer.size(), packet.address);
+    packet.buffer.resize(len);
+    return packet;
+}
+
+size_t UDPSocket::receive(uint8_t *buf, size_t max_size, InetAddress& source)
+{
     socklen_t addrSize;
-    addrSize = sizeof(*packet.address.as_sockaddr());
+    addrSize = sizeof(source.addr);
     ssize_t ret = recvfrom(m_sock,
-            packet.buffer.data(),
-            packet.buffer.size(),
+            buf,
+            max_size,
             0,
-            packet.address.as_sockaddr(),
+            source.as_sockaddr(),
             &addrSize);
 
     if (ret == SOCKET_ERROR) {
-        packet.buffer.resize(0);
+        // This suppresses the -Wlogical-op warning
+#if EAGAIN == EWOULDBLOCK
+        if (errno == EAGAIN)
+#else
+        if (errno == EAGAIN or errno == EWOULDBLOCK)
+#endif
+        {
+            return 0;
+        }
+        throw runtime_error(string("Can't receive data: ") + strerror(errno));
+    }
+
+    return ret;
+}
+
+size_t UDPSocket::receiveBatch(std::vector<UDPPacket>& packets, size_t max_size)
+{
+#if defined(HAVE_RECVMMSG)
+    constexpr size_t MAX_BATCH = 64;
+    struct mmsghdr msgs[MAX_BATCH];
+    struct iovec iovecs[MAX_BATCH];
+    TimestampControl controls[MAX_BATCH];
+
+    const size_t num_packets = std::min(packets.size(), MAX_BATCH);
+    for (size_t i = 0; i < num_packets; i++) {
+        auto& packet = packets[i];
+        packet.buffer.resize(max_size);
 
+        iovecs[i].iov_base = packet.buffer.data();
+        iovecs[i].iov_len = packet.buffer.size();
+
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = packet.address.as_sockaddr();
+        msgs[i].msg_hdr.msg_namelen = sizeof(packet.address.addr);
+        msgs[i].msg_hdr.msg_control = controls[i].buf;
+        msgs[i].msg_hdr.msg_controllen = sizeof(controls[i].buf);
+    }
+
+    // MSG_WAITFORONE makes a blocking socket return as soon as the first packet has
+    // been received, together with all others that are already queued.
+    const int ret = recvmmsg(m_sock, msgs, num_packets, MSG_WAITFORONE, nullptr);
+
+    if (ret == SOCKET_ERROR) {
         // This suppresses the -Wlogical-op warning
 #if EAGAIN == EWOULDBLOCK
         if (errno == EAGAIN)
@@ -237,8 +347,55 @@ UDPPacket UDPSocket::receive(size_t max_size)
         throw runtime_error(string("Can't receive data: ") + strerror(errno));
     }
 
-    packet.buffer.resize(ret);
-    return packet;
+    const auto now = chrono::system_clock::now();
+    for (int i = 0; i < ret; i++) {
+        packets[i].buffer.resize(msgs[i].msg_len);
+        packets[i].timestamp = receiveTimestamp(msgs[i].msg_hdr, now);
+    }
+
+    return ret;
+#else
+    size_t num_received = 0;
+    for (auto& packet : packets) {
+        packet.buffer.resize(max_size);
+
+        struct iovec iov;
+        iov.iov_base = packet.buffer.data();
+        iov.iov_len = packet.buffer.size();
+
+        TimestampControl control;
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_name = packet.address.as_sockaddr();
+        msg.msg_namelen = sizeof(packet.address.addr);
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        // Only the first receive may block
+        ssize_t ret = recvmsg(m_sock, &msg, num_received == 0 ? 0 : MSG_DONTWAIT);
+
+        if (ret == SOCKET_ERROR) {
+            // This suppresses the -Wlogical-op warning
+#if EAGAIN == EWOULDBLOCK
+            if (errno == EAGAIN)
+#else
+            if (errno == EAGAIN or errno == EWOULDBLOCK)
+#endif
+            {
+                break;
+            }
+            throw runtime_error(string("Can't receive data: ") + strerror(errno));
+        }
+
+        packet.buffer.resize(ret);
+        packet.timestamp = receiveTimestamp(msg, chrono::system_clock::now());
+        num_received++;
+    }
+
+    return num_received;
+#endif
 }
 
 void UDPSocket::send(UDPPacket& packet)
@@ -253,7 +410,12 @@ void UDPSocket::send(UDPPacket& packet)
 
 void UDPSocket::send(const std::vector<uint8_t>& data, InetAddress destination)
 {
-    const int ret = sendto(m_sock, data.data(), data.size(), 0,
+    send(data.data(), data.size(), destination);
+}
+
+void UDPSocket::send(const uint8_t *data, size_t size, InetAddress destination)
+{
+    const int ret = sendto(m_sock, data, size, 0,
             destination.as_sockaddr(), sizeof(*destination.as_sockaddr()));
     if (ret == SOCKET_ERROR && errno != ECONNREFUSED) {
         throw runtime_error(string("Can't send UDP packet: ") + strerror(errno));
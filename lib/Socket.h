@@ -31,6 +31,7 @@
 #include "ThreadsafeQueue.h"
 #include <cstdlib>
 #include <atomic>
+#include <chrono>
 #include <iostream>
 #include <list>
 #include <memory>
@@ -74,6 +75,11 @@ class UDPPacket
 
         std::vector<uint8_t> buffer;
         InetAddress address;
+
+        /* For incoming packets, the time at which the packet was received.
+         * It is taken by the kernel when receive timestamps are enabled,
+         * otherwise it is the time the receive call returned. */
+        std::chrono::system_clock::time_point timestamp;
 };
 
 /**
@@ -115,8 +121,25 @@ class UDPSocket
         void close(void);
         void send(UDPPacket& packet);
         void send(const std::vector<uint8_t>& data, InetAddress destination);
+        void send(const uint8_t *data, size_t size, InetAddress destination);
         void send(const std::string& data, InetAddress destination);
         UDPPacket receive(size_t max_size);
+
+        /** Receive one packet into a buffer owned by the caller, without
+         *  allocating memory. The address of the sender is written into source.
+         *  Returns the number of bytes received, 0 if no data is available on a
+         *  non-blocking socket. Throws a runtime_error on error.
+         */
+        size_t receive(uint8_t *buf, size_t max_size, InetAddress& source);
+
+        /** Receive up to packets.size() packets with a single system call.
+         *  The buffer of each packet is resized to max_size before receiving,
+         *  and to the received length afterwards, which means the packets can
+         *  be reused without new allocations.
+         *  Returns the number of packets received, 0 if no data is available on
+         *  a non-blocking socket. Throws a runtime_error on error.
+         */
+        size_t receiveBatch(std::vector<UDPPacket>& packets, size_t max_size);
         void joinGroup(const char* groupname, const char* if_addr = nullptr);
         void setMulticastSource(const char* source_addr);
         void setMulticastTTL(int ttl);
@@ -126,6 +149,12 @@ class UDPSocket
          */
         void setBlocking(bool block);
 
+        /** Ask the kernel to timestamp incoming packets on arrival, for
+         * receiveBatch(). Returns false if the platform or the socket
+         * doesn't support it.
+         */
+        bool enableTimestamps();
+
         SOCKET getNativeSocket() const;
         int getPort() const;
 
@@ -30,6 +30,7 @@
 
 #include <mutex>
 #include <condition_variable>
+#include <chrono>
 #include <queue>
 #include <utility>
 #include <cassert>
@@ -197,7 +198,7 @@ public:
             return false;
         }
 
-        popped_value = the_queue.front();
+        popped_value = std::move(the_queue.front());
         the_queue.pop();
 
         lock.unlock();
@@ -227,6 +228,38 @@ public:
         }
     }
 
+    /* Like wait_and_pop, but give up at the deadline.
+     *
+     * returns true if an element was popped, false on timeout.
+     */
+    template<typename Clock, typename Duration>
+    bool wait_and_pop_until(T& popped_value,
+            const std::chrono::time_point<Clock, Duration>& deadline)
+    {
+        std::unique_lock<std::mutex> lock(the_mutex);
+        while (the_queue.empty() and not wakeup_requested) {
+            if (the_rx_notification.wait_until(lock, deadline) == std::cv_status::timeout) {
+                break;
+            }
+        }
+
+        if (wakeup_requested) {
+            wakeup_requested = false;
+            throw ThreadsafeQueueWakeup();
+        }
+        else if (the_queue.empty()) {
+            return false;
+        }
+        else {
+            std::swap(popped_value, the_queue.front());
+            the_queue.pop();
+
+            lock.unlock();
+            the_tx_notification.notify_one();
+            return true;
+        }
+    }
+
 private:
     std::queue<T> the_queue;
     mutable std::mutex the_mutex;
@@ -46,7 +46,10 @@ class AFPacketiser
         AFPacketiser(bool verbose) :
             m_verbose(verbose) {};
 
-        AFPacket Assemble(TagPacket tag_packet);
+        AFPacket Assemble(const TagPacket& tag_packet);
+
+        // Assemble the AF packet into packet, whose storage is reused
+        void Assemble(const TagPacket& tag_packet, AFPacket& packet);
 
         void OverrideSeq(uint16_t seq);
 
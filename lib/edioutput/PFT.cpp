@@ -31,16 +31,16 @@
  */
 
 #include <vector>
-#include <list>
+#include <memory>
 #include <cstdio>
 #include <cstring>
 #include <cstdint>
 #include <arpa/inet.h>
 #include <stdexcept>
 #include <sstream>
+#include <algorithm>
 #include "PFT.h"
 #include "crc.h"
-#include "ReedSolomon.h"
 
 namespace edi {
 
@@ -72,10 +72,15 @@ PFT::PFT(const configuration_t &conf) :
         }
     }
 
-RSBlock PFT::Protect(AFPacket af_packet)
+RSBlock PFT::Protect(const AFPacket& af_packet)
 {
     RSBlock rs_block;
+    Protect(af_packet, rs_block);
+    return rs_block;
+}
 
+void PFT::Protect(const AFPacket& af_packet, RSBlock& rs_block)
+{
     // number of chunks is ceil(afpacketsize / m_k)
     // TS 102 821 7.2.2: c = ceil(l / k_max)
     m_num_chunks = CEIL_DIV(af_packet.size(), m_k);
@@ -99,66 +104,76 @@ RSBlock PFT::Protect(AFPacket af_packet)
     // TS 102 821 7.2.2: z = c*k - l
     const size_t zero_pad = m_num_chunks * chunk_len - af_packet.size();
 
-    // Create the RS(k+p,k) encoder
-    const int firstRoot = 1; // Discovered by analysing EDI dump
-    const int gfPoly = 0x11d;
-    const bool reverse = false;
-    // The encoding has to be 255, 207 always, because the chunk has to
-    // be padded at the end, and not at the beginning as libfec would
-    // do
-    ReedSolomon rs_encoder(255, 207, reverse, gfPoly, firstRoot);
-
-    // add zero padding to last chunk
-    for (size_t i = 0; i < zero_pad; i++) {
-        af_packet.push_back(0);
-    }
-
     if (m_verbose) {
         fprintf(stderr, "        add %zu zero padding\n", zero_pad);
     }
 
-    // Calculate RS for each chunk and assemble RS block
-    for (size_t i = 0; i < af_packet.size(); i+= chunk_len) {
-        vector<uint8_t> chunk(207);
-        vector<uint8_t> protection(PARITYBYTES);
-
-        // copy chunk_len bytes into new chunk
-        memcpy(&chunk.front(), &af_packet[i], chunk_len);
+    // The RS block holds every chunk followed by its protection. The
+    // zero padding of the last chunk is part of the block.
+    rs_block.resize(m_num_chunks * (chunk_len + PARITYBYTES));
 
-        // calculate RS for chunk with padding
-        rs_encoder.encode(&chunk.front(), &protection.front(), 207);
+    // Calculate RS for each chunk and assemble RS block. The encoding
+    // is always RS(255, 207), with the chunk padded with zeros at the
+    // end, not at the beginning as a shortened code would be.
+    for (size_t c = 0; c < m_num_chunks; c++) {
+        const size_t offset = c * chunk_len;
+        const size_t len = std::min(chunk_len, af_packet.size() - offset);
 
-        // Drop the padding
-        chunk.resize(chunk_len);
+        uint8_t *chunk = &rs_block[c * (chunk_len + PARITYBYTES)];
+        memcpy(chunk, &af_packet[offset], len);
+        memset(chunk + len, 0, chunk_len - len);
 
-        // append new chunk and protection to the RS Packet
-        rs_block.insert(rs_block.end(), chunk.begin(), chunk.end());
-        rs_block.insert(rs_block.end(), protection.begin(), protection.end());
+        m_rs_encoder.encode(chunk, len, chunk + chunk_len);
     }
+}
 
-    return rs_block;
+// Side length of the tiles of the interleaver transpose. A tile of the
+// source and one of the destination stay in cache while it is copied.
+static const size_t TRANSPOSE_TILE = 32;
+
+/* Copy the rows x cols matrix src, stored row by row, into dst, such that
+ * column i of src is at dst + i * dst_stride. */
+static void transpose(const uint8_t *src, size_t rows, size_t cols,
+        uint8_t *dst, size_t dst_stride)
+{
+    for (size_t r0 = 0; r0 < rows; r0 += TRANSPOSE_TILE) {
+        const size_t r1 = std::min(r0 + TRANSPOSE_TILE, rows);
+
+        for (size_t c0 = 0; c0 < cols; c0 += TRANSPOSE_TILE) {
+            const size_t c1 = std::min(c0 + TRANSPOSE_TILE, cols);
+
+            for (size_t c = c0; c < c1; c++) {
+                uint8_t *out = dst + c * dst_stride;
+                for (size_t r = r0; r < r1; r++) {
+                    out[r] = src[r * cols + c];
+                }
+            }
+        }
+    }
 }
 
-vector< vector<uint8_t> > PFT::ProtectAndFragment(AFPacket af_packet)
+std::vector< PFTFragment > PFT::Assemble(const AFPacket& af_packet)
 {
     const bool enable_RS = (m_m > 0);
 
+    // Payload of all fragments, they are the RS block or the AF packet
+    // cut into pieces
+    const uint8_t *payload = nullptr;
+    size_t payload_len = 0;
+    size_t num_fragments = 0;
+    size_t fragment_size = 0;
+
+    size_t chunk_len = 0;
+    size_t zero_pad = 0;
+
     if (enable_RS) {
-        RSBlock rs_block = Protect(af_packet);
+        Protect(af_packet, m_rs_block);
 
-#if 0
-        fprintf(stderr, "  af_packet (%zu):", af_packet.size());
-        for (size_t i = 0; i < af_packet.size(); i++) {
-            fprintf(stderr, "%02x ", af_packet[i]);
-        }
-        fprintf(stderr, "\n");
+        // TS 102 821 7.2.2: k = ceil(l / c)
+        chunk_len = CEIL_DIV(af_packet.size(), m_num_chunks);
 
-        fprintf(stderr, "  rs_block (%zu):", rs_block.size());
-        for (size_t i = 0; i < rs_block.size(); i++) {
-            fprintf(stderr, "%02x ", rs_block[i]);
-        }
-        fprintf(stderr, "\n");
-#endif
+        // TS 102 821 7.2.2: z = c*k - l
+        zero_pad = m_num_chunks * chunk_len - af_packet.size();
 
         // TS 102 821 7.2.2: s_max = MIN(floor(c*p/(m+1)), MTU - h))
         const size_t max_payload_size = ( m_num_chunks * PARITYBYTES ) / (m_m + 1);
@@ -166,31 +181,23 @@ vector< vector<uint8_t> > PFT::ProtectAndFragment(AFPacket af_packet)
         // Calculate fragment count and size
         // TS 102 821 7.2.2: ceil((l + c*p + z) / s_max)
         // l + c*p + z = length of RS block
-        const size_t num_fragments = CEIL_DIV(rs_block.size(), max_payload_size);
+        num_fragments = CEIL_DIV(m_rs_block.size(), max_payload_size);
 
         // TS 102 821 7.2.2: ceil((l + c*p + z) / f)
-        const size_t fragment_size = CEIL_DIV(rs_block.size(), num_fragments);
+        fragment_size = CEIL_DIV(m_rs_block.size(), num_fragments);
 
         if (m_verbose)
             fprintf(stderr, "  PnF fragment_size %zu, num frag %zu\n",
                     fragment_size, num_fragments);
 
-        vector< vector<uint8_t> > fragments(num_fragments);
+        // The fragments are interleaved: byte j of fragment i is byte
+        // j*num_fragments + i of the RS block, and the bytes beyond the RS
+        // block are zero. Padding the block to a full matrix makes the
+        // interleaving a transpose.
+        m_rs_block.resize(num_fragments * fragment_size, 0);
 
-        for (size_t i = 0; i < num_fragments; i++) {
-            fragments[i].resize(fragment_size);
-            for (size_t j = 0; j < fragment_size; j++) {
-                const size_t ix = j*num_fragments + i;
-                if (ix < rs_block.size()) {
-                    fragments[i][j] = rs_block[ix];
-                }
-                else {
-                    fragments[i][j] = 0;
-                }
-            }
-        }
-
-        return fragments;
+        payload = m_rs_block.data();
+        payload_len = m_rs_block.size();
     }
     else { // No RS, only fragmentation
         // TS 102 821 7.2.2: s_max = MTU - h
@@ -201,74 +208,70 @@ vector< vector<uint8_t> > PFT::ProtectAndFragment(AFPacket af_packet)
         // Calculate fragment count and size
         // TS 102 821 7.2.2: ceil((l + c*p + z) / s_max)
         // l + c*p + z = length of AF packet
-        const size_t num_fragments = CEIL_DIV(af_packet.size(), max_payload_size);
+        num_fragments = CEIL_DIV(af_packet.size(), max_payload_size);
 
         // TS 102 821 7.2.2: ceil((l + c*p + z) / f)
-        const size_t fragment_size = CEIL_DIV(af_packet.size(), num_fragments);
-        vector< vector<uint8_t> > fragments(num_fragments);
+        fragment_size = CEIL_DIV(af_packet.size(), num_fragments);
 
-        for (size_t i = 0; i < num_fragments; i++) {
-            fragments[i].reserve(fragment_size);
+        payload = af_packet.data();
+        payload_len = af_packet.size();
+    }
 
-            for (size_t j = 0; j < fragment_size; j++) {
-                const size_t ix = i*fragment_size + j;
-                if (ix < af_packet.size()) {
-                    fragments[i].push_back(af_packet.at(ix));
-                }
-                else {
-                    break;
-                }
-            }
-        }
+    // PF header including the RS and transport fields, and the CRC
+    const size_t header_len = 12 +
+        (enable_RS ? 2 : 0) +
+        (m_transport_header ? 4 : 0) + 2;
 
-        return fragments;
-    }
-}
+    // All fragments with their headers are placed one after the other in
+    // one slab, of which the fragments are views.
+    const size_t stride = header_len + fragment_size;
+    auto slab = make_shared<vector<uint8_t> >(num_fragments * stride);
+    uint8_t *slab_data = slab->data();
 
-std::vector< PFTFragment > PFT::Assemble(AFPacket af_packet)
-{
-    vector< vector<uint8_t> > fragments = ProtectAndFragment(af_packet);
-    vector< vector<uint8_t> > pft_fragments; // These contain PF headers
+    if (enable_RS) {
+        transpose(payload, fragment_size, num_fragments,
+                slab_data + header_len, stride);
+    }
 
-    const bool enable_RS = (m_m > 0);
+    vector<PFTFragment> pft_fragments;
+    pft_fragments.reserve(num_fragments);
 
-    unsigned int findex = 0;
+    const unsigned int fcount = num_fragments;
 
-    unsigned fcount = fragments.size();
+    for (unsigned int findex = 0; findex < fcount; findex++) {
+        uint8_t *packet = slab_data + findex * stride;
 
-    // calculate size of chunk:
-    // TS 102 821 7.2.2: k = ceil(l / c)
-    // chunk_len does not include the 48 bytes of protection.
-    const size_t chunk_len = enable_RS ?
-        CEIL_DIV(af_packet.size(), m_num_chunks) : 0;
+        // Without RS, the fragments are consecutive pieces of the AF
+        // packet, the last one can be shorter
+        size_t plen_bytes = fragment_size;
+        if (not enable_RS) {
+            const size_t offset = findex * fragment_size;
+            plen_bytes = std::min(fragment_size, payload_len - offset);
+            memcpy(packet + header_len, payload + offset, plen_bytes);
+        }
 
-    // The last RS chunk is zero padded
-    // TS 102 821 7.2.2: z = c*k - l
-    const size_t zero_pad = enable_RS ?
-        m_num_chunks * chunk_len - af_packet.size() : 0;
+        size_t i = 0;
 
-    for (const auto &fragment : fragments) {
         // Psync
-        std::string psync("PF");
-        std::vector<uint8_t> packet(psync.begin(), psync.end());
+        packet[i++] = 'P';
+        packet[i++] = 'F';
 
         // Pseq
-        packet.push_back(m_pseq >> 8);
-        packet.push_back(m_pseq & 0xFF);
+        packet[i++] = m_pseq >> 8;
+        packet[i++] = m_pseq & 0xFF;
 
         // Findex
-        packet.push_back(findex >> 16);
-        packet.push_back(findex >> 8);
-        packet.push_back(findex & 0xFF);
-        findex++;
+        packet[i++] = findex >> 16;
+        packet[i++] = findex >> 8;
+        packet[i++] = findex & 0xFF;
 
         // Fcount
-        packet.push_back(fcount >> 16);
-        packet.push_back(fcount >> 8);
-        packet.push_back(fcount & 0xFF);
+        packet[i++] = fcount >> 16;
+        packet[i++] = fcount >> 8;
+        packet[i++] = fcount & 0xFF;
 
         // RS (1 bit), transport (1 bit) and Plen (14 bits)
-        unsigned int plen = fragment.size();
+        unsigned int plen = plen_bytes;
         if (enable_RS) {
             plen |= 0x8000; // Set FEC bit
         }
@@ -277,36 +280,33 @@ std::vector< PFTFragment > PFT::Assemble(AFPacket af_packet)
             plen |= 0x4000; // Set ADDR bit
         }
 
-        packet.push_back(plen >> 8);
-        packet.push_back(plen & 0xFF);
+        packet[i++] = plen >> 8;
+        packet[i++] = plen & 0xFF;
 
         if (enable_RS) {
-            packet.push_back(chunk_len);   // RSk
-            packet.push_back(zero_pad);    // RSz
+            packet[i++] = chunk_len;   // RSk
+            packet[i++] = zero_pad;    // RSz
         }
 
         if (m_transport_header) {
             // Source (16 bits)
-            packet.push_back(m_addr_source >> 8);
-            packet.push_back(m_addr_source & 0xFF);
+            packet[i++] = m_addr_source >> 8;
+            packet[i++] = m_addr_source & 0xFF;
 
             // Dest (16 bits)
-            packet.push_back(m_dest_port >> 8);
-            packet.push_back(m_dest_port & 0xFF);
+            packet[i++] = m_dest_port >> 8;
+            packet[i++] = m_dest_port & 0xFF;
         }
 
-        // calculate CRC over AF Header and payload
+        // calculate CRC over the PF header
         uint16_t crc = 0xffff;
-        crc = crc16(crc, &(packet.front()), packet.size());
+        crc = crc16(crc, packet, i);
         crc ^= 0xffff;
 
-        packet.push_back((crc >> 8) & 0xFF);
-        packet.push_back(crc & 0xFF);
-
-        // insert payload, must have a length multiple of 8 bytes
-        packet.insert(packet.end(), fragment.begin(), fragment.end());
+        packet[i++] = (crc >> 8) & 0xFF;
+        packet[i++] = crc & 0xFF;
 
-        pft_fragments.push_back(packet);
+        pft_fragments.emplace_back(slab, findex * stride, header_len + plen_bytes);
 
 #if 0
         fprintf(stderr, "* PFT pseq %d, findex %d, fcount %d, plen %d\n",
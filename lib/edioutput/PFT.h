@@ -33,46 +33,72 @@
 #pragma once
 
 #include <vector>
-#include <list>
+#include <memory>
 #include <stdexcept>
 #include <cstdint>
 #include "AFPacket.h"
 #include "Log.h"
-#include "ReedSolomon.h"
+#include "RSEncoder.h"
 #include "EDIConfig.h"
 
 namespace edi {
 
 typedef std::vector<uint8_t> RSBlock;
-typedef std::vector<uint8_t> PFTFragment;
+
+// A PFT fragment including its PF header. All fragments of an AF packet
+// are views into the same buffer, which lives as long as one of them.
+class PFTFragment
+{
+    public:
+        PFTFragment() = default;
+        PFTFragment(std::shared_ptr<const std::vector<uint8_t> > slab,
+                size_t offset, size_t size) :
+            m_slab(slab), m_offset(offset), m_size(size) {}
+
+        const uint8_t *data() const { return m_slab->data() + m_offset; }
+        size_t size() const { return m_size; }
+        const uint8_t *begin() const { return data(); }
+        const uint8_t *end() const { return data() + m_size; }
+
+    private:
+        std::shared_ptr<const std::vector<uint8_t> > m_slab;
+        size_t m_offset = 0;
+        size_t m_size = 0;
+};
 
 class PFT
 {
     public:
-        static constexpr int PARITYBYTES = 48;
+        static constexpr int PARITYBYTES = RSEncoder::PARITYBYTES;
 
         PFT();
         PFT(const configuration_t& conf);
 
         // return a list of PFT fragments with the correct
         // PFT headers
-        std::vector< PFTFragment > Assemble(AFPacket af_packet);
+        std::vector< PFTFragment > Assemble(const AFPacket& af_packet);
 
         // Apply Reed-Solomon FEC to the AF Packet
-        RSBlock Protect(AFPacket af_packet);
-
-        // Cut a RSBlock into several fragments that can be transmitted
-        std::vector< std::vector<uint8_t> > ProtectAndFragment(AFPacket af_packet);
+        RSBlock Protect(const AFPacket& af_packet);
 
         void OverridePSeq(uint16_t pseq);
 
     private:
+        // Apply Reed-Solomon FEC to the AF Packet, into rs_block
+        void Protect(const AFPacket& af_packet, RSBlock& rs_block);
+
         unsigned int m_k = 207; // length of RS data word
         unsigned int m_m = 3; // number of fragments that can be recovered if lost
         uint16_t m_pseq = 0;
         size_t m_num_chunks = 0;
         bool m_verbose = false;
 
+        // Set up once, its tables are used for every AF packet
+        RSEncoder m_rs_encoder;
+
+        // Reused for every AF packet
+        RSBlock m_rs_block;
+
         // Transport header is always deactivated
         const bool m_transport_header = false;
         const uint16_t m_addr_source = 0;
@@ -0,0 +1,166 @@
+/*
+   Copyright (C) 2021
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://www.opendigitalradio.org
+
+   EDI output,
+   Reed-Solomon encoder for the PFT layer.
+
+   */
+/*
+   This file is part of the ODR-mmbTools.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RSEncoder.h"
+#include <cstring>
+#include <stdexcept>
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#  include <arm_neon.h>
+#else
+#  include <endian.h>
+#endif
+
+namespace edi {
+
+static_assert(RSEncoder::PARITYBYTES == 48, "The parity register is three vectors wide");
+
+static const int GF_POLY = 0x11d;
+static const int FIRST_ROOT = 1;
+
+static uint8_t gf_mul(uint8_t a, uint8_t b)
+{
+    uint8_t r = 0;
+    while (b) {
+        if (b & 1) {
+            r ^= a;
+        }
+        b >>= 1;
+        a = (a & 0x80) ? ((a << 1) ^ GF_POLY) : (a << 1);
+    }
+    return r;
+}
+
+RSEncoder::RSEncoder()
+{
+    // g(x) = (x - alpha^1) (x - alpha^2) ... (x - alpha^48), with the
+    // coefficient of x^i in gen[i]
+    uint8_t gen[PARITYBYTES + 1] = {1};
+    uint8_t root = 1;
+    for (int i = 0; i < FIRST_ROOT; i++) {
+        root = gf_mul(root, 2);
+    }
+
+    for (size_t i = 0; i < PARITYBYTES; i++) {
+        gen[i + 1] = 1;
+        for (size_t j = i; j > 0; j--) {
+            gen[j] = gen[j - 1] ^ gf_mul(gen[j], root);
+        }
+        gen[0] = gf_mul(gen[0], root);
+        root = gf_mul(root, 2);
+    }
+
+    if (gen[PARITYBYTES] != 1) {
+        throw std::logic_error("RSEncoder: invalid generator polynomial");
+    }
+
+    // Byte 0 of the register is the one the next feedback is taken from,
+    // it is multiplied with the highest coefficient
+    for (int f = 0; f < 256; f++) {
+        for (size_t i = 0; i < PARITYBYTES; i++) {
+            m_table[f][i] = gf_mul(f, gen[PARITYBYTES - 1 - i]);
+        }
+    }
+}
+
+void RSEncoder::encode(const uint8_t *data, size_t len, uint8_t *parity) const
+{
+    if (len > K) {
+        throw std::invalid_argument("RSEncoder: data too long");
+    }
+
+    // Every step shifts the register by one byte towards byte 0, and adds
+    // the product of the feedback and the generator polynomial.
+#if defined(__SSE2__)
+    __m128i r0 = _mm_setzero_si128();
+    __m128i r1 = _mm_setzero_si128();
+    __m128i r2 = _mm_setzero_si128();
+
+    for (size_t i = 0; i < K; i++) {
+        const uint8_t d = i < len ? data[i] : 0;
+        const uint8_t f = d ^ (uint8_t)_mm_cvtsi128_si32(r0);
+        const __m128i *t = reinterpret_cast<const __m128i*>(m_table[f]);
+
+        r0 = _mm_or_si128(_mm_srli_si128(r0, 1), _mm_slli_si128(r1, 15));
+        r1 = _mm_or_si128(_mm_srli_si128(r1, 1), _mm_slli_si128(r2, 15));
+        r2 = _mm_srli_si128(r2, 1);
+
+        r0 = _mm_xor_si128(r0, _mm_load_si128(t));
+        r1 = _mm_xor_si128(r1, _mm_load_si128(t + 1));
+        r2 = _mm_xor_si128(r2, _mm_load_si128(t + 2));
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(parity), r0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(parity + 16), r1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(parity + 32), r2);
+#elif defined(__ARM_NEON)
+    const uint8x16_t zero = vdupq_n_u8(0);
+    uint8x16_t r0 = zero;
+    uint8x16_t r1 = zero;
+    uint8x16_t r2 = zero;
+
+    for (size_t i = 0; i < K; i++) {
+        const uint8_t d = i < len ? data[i] : 0;
+        const uint8_t f = d ^ vgetq_lane_u8(r0, 0);
+        const uint8_t *t = m_table[f];
+
+        r0 = veorq_u8(vextq_u8(r0, r1, 1), vld1q_u8(t));
+        r1 = veorq_u8(vextq_u8(r1, r2, 1), vld1q_u8(t + 16));
+        r2 = veorq_u8(vextq_u8(r2, zero, 1), vld1q_u8(t + 32));
+    }
+
+    vst1q_u8(parity, r0);
+    vst1q_u8(parity + 16, r1);
+    vst1q_u8(parity + 32, r2);
+#else
+    // Byte 0 of the register is the least significant byte of r[0]
+    const size_t W = PARITYBYTES / 8;
+    uint64_t r[W] = {};
+
+    for (size_t i = 0; i < K; i++) {
+        const uint8_t d = i < len ? data[i] : 0;
+        const uint8_t f = d ^ (uint8_t)r[0];
+
+        uint64_t t[W];
+        memcpy(t, m_table[f], sizeof(t));
+
+        for (size_t w = 0; w < W - 1; w++) {
+            r[w] = ((r[w] >> 8) | (r[w + 1] << 56)) ^ le64toh(t[w]);
+        }
+        r[W - 1] = (r[W - 1] >> 8) ^ le64toh(t[W - 1]);
+    }
+
+    for (size_t w = 0; w < W; w++) {
+        const uint64_t v = htole64(r[w]);
+        memcpy(parity + 8 * w, &v, sizeof(v));
+    }
+#endif
+}
+
+}
+
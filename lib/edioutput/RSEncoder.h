@@ -0,0 +1,67 @@
+/*
+   Copyright (C) 2021
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://www.opendigitalradio.org
+
+   EDI output,
+   Reed-Solomon encoder for the PFT layer.
+
+   */
+/*
+   This file is part of the ODR-mmbTools.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace edi {
+
+/* Systematic RS(255, 207) encoder over GF(2^8) with the field generator
+ * polynomial 0x11d and the first consecutive root alpha^1, as used by the
+ * PFT layer (ETSI TS 102 821, 7.2). It gives the same parity as the libfec
+ * based ReedSolomon class with these parameters.
+ *
+ * The product of every feedback byte with the generator polynomial is
+ * precomputed, so that encoding a byte is one table lookup and a 48 byte
+ * shift and XOR of the parity register, which is kept in vector registers
+ * if SSE2 or NEON is available.
+ */
+class RSEncoder
+{
+    public:
+        static constexpr size_t N = 255;
+        static constexpr size_t K = 207;
+        static constexpr size_t PARITYBYTES = N - K;
+
+        RSEncoder();
+        RSEncoder(const RSEncoder& other) = delete;
+        RSEncoder& operator=(const RSEncoder& other) = delete;
+
+        /* Compute the parity of the len bytes of data, followed by
+         * K - len zero bytes, and write it to parity. */
+        void encode(const uint8_t *data, size_t len, uint8_t *parity) const;
+
+    private:
+        /* m_table[f][i] is byte i of the product of feedback f and the
+         * generator polynomial, in the order of the parity register */
+        alignas(16) uint8_t m_table[256][PARITYBYTES];
+};
+
+}
+
@@ -35,6 +35,29 @@
 
 namespace edi {
 
+/* Append the TAG name and a placeholder for the TAG length to buf.
+ * Returns the offset of the TAG item in buf */
+static size_t begin_tag(std::vector<uint8_t>& buf, const char name[4])
+{
+    const size_t start = buf.size();
+    buf.insert(buf.end(), name, name + 4);
+    buf.insert(buf.end(), 4, 0);
+    return start;
+}
+
+/* Fill the TAG length of the TAG item at offset start, which ends
+ * at the end of buf */
+static void end_tag(std::vector<uint8_t>& buf, size_t start)
+{
+    // remove TAG name and TAG length fields and convert to bits
+    const uint32_t taglength = (buf.size() - start - 8) * 8;
+
+    buf[start + 4] = (taglength >> 24) & 0xFF;
+    buf[start + 5] = (taglength >> 16) & 0xFF;
+    buf[start + 6] = (taglength >> 8) & 0xFF;
+    buf[start + 7] = taglength & 0xFF;
+}
+
 TagStarPTR::TagStarPTR(const std::string& protocol)
     : m_protocol(protocol)
 {
@@ -43,16 +66,10 @@ TagStarPTR::TagStarPTR(const std::string& protocol)
     }
 }
 
-std::vector<uint8_t> TagStarPTR::Assemble()
+void TagStarPTR::AssembleInto(std::vector<uint8_t>& packet)
 {
     //std::cerr << "TagItem *ptr" << std::endl;
-    std::string pack_data("*ptr");
-    std::vector<uint8_t> packet(pack_data.begin(), pack_data.end());
-
-    packet.push_back(0);
-    packet.push_back(0);
-    packet.push_back(0);
-    packet.push_back(0x40);
+    const size_t start = begin_tag(packet, "*ptr");
 
     packet.insert(packet.end(), m_protocol.begin(), m_protocol.end());
 
@@ -63,20 +80,13 @@ std::vector<uint8_t> TagStarPTR::Assemble()
     // Minor
     packet.push_back(0);
     packet.push_back(0);
-    return packet;
+
+    end_tag(packet, start);
 }
 
-std::vector<uint8_t> TagDETI::Assemble()
+void TagDETI::AssembleInto(std::vector<uint8_t>& packet)
 {
-    std::string pack_data("deti");
-    std::vector<uint8_t> packet(pack_data.begin(), pack_data.end());
-    packet.reserve(256);
-
-    // Placeholder for length
-    packet.push_back(0);
-    packet.push_back(0);
-    packet.push_back(0);
-    packet.push_back(0);
+    const size_t start = begin_tag(packet, "deti");
 
     uint8_t fct  = dlfc % 250;
     uint8_t fcth = dlfc / 250;
@@ -107,9 +117,7 @@ std::vector<uint8_t> TagDETI::Assemble()
     }
 
     if (ficf) {
-        for (size_t i = 0; i < fic_length; i++) {
-            packet.push_back(fic_data[i]);
-        }
+        packet.insert(packet.end(), fic_data, fic_data + fic_length);
     }
 
     if (rfudf) {
@@ -118,24 +126,14 @@ std::vector<uint8_t> TagDETI::Assemble()
         packet.push_back(rfud & 0xFF);
     }
 
-    // calculate and update size
-    // remove TAG name and TAG length fields and convert to bits
-    uint32_t taglength = (packet.size() - 8) * 8;
-
-    // write length into packet
-    packet[4] = (taglength >> 24) & 0xFF;
-    packet[5] = (taglength >> 16) & 0xFF;
-    packet[6] = (taglength >> 8) & 0xFF;
-    packet[7] = taglength & 0xFF;
+    end_tag(packet, start);
 
     dlfc = (dlfc+1) % 5000;
 
     /*
     std::cerr << "TagItem deti, packet.size " << packet.size() << std::endl;
     std::cerr << "              fic length " << fic_length << std::endl;
-    std::cerr << "              length " << taglength / 8 << std::endl;
     */
-    return packet;
 }
 
 void TagDETI::set_edi_time(const std::time_t t, int tai_utc_offset)
@@ -147,19 +145,9 @@ void TagDETI::set_edi_time(const std::time_t t, int tai_utc_offset)
     seconds = t - posix_timestamp_1_jan_2000 + utco;
 }
 
-std::vector<uint8_t> TagESTn::Assemble()
+void TagESTn::AssembleInto(std::vector<uint8_t>& packet)
 {
-    std::string pack_data("est");
-    std::vector<uint8_t> packet(pack_data.begin(), pack_data.end());
-    packet.reserve(mst_length*8 + 16);
-
-    packet.push_back(id);
-
-    // Placeholder for length
-    packet.push_back(0);
-    packet.push_back(0);
-    packet.push_back(0);
-    packet.push_back(0);
+    const char name[4] = {'e', 's', 't', (char)id};
 
     if (tpl > 0x3F) {
         throw std::runtime_error("TagESTn: invalid TPL value");
@@ -173,43 +161,26 @@ std::vector<uint8_t> TagESTn::Assemble()
         throw std::runtime_error("TagESTn: invalid SCID value");
     }
 
+    const size_t start = begin_tag(packet, name);
+
     uint32_t sstc = (scid << 18) | (sad << 8) | (tpl << 2) | rfa;
     packet.push_back((sstc >> 16) & 0xFF);
     packet.push_back((sstc >> 8) & 0xFF);
     packet.push_back(sstc & 0xFF);
 
-    for (size_t i = 0; i < mst_length * 8; i++) {
-        packet.push_back(mst_data[i]);
-    }
+    packet.insert(packet.end(), mst_data, mst_data + mst_length * 8);
 
-    // calculate and update size
-    // remove TAG name and TAG length fields and convert to bits
-    uint32_t taglength = (packet.size() - 8) * 8;
-
-    // write length into packet
-    packet[4] = (taglength >> 24) & 0xFF;
-    packet[5] = (taglength >> 16) & 0xFF;
-    packet[6] = (taglength >> 8) & 0xFF;
-    packet[7] = taglength & 0xFF;
+    end_tag(packet, start);
 
     /*
     std::cerr << "TagItem ESTn, length " << packet.size() << std::endl;
     std::cerr << "              mst_length " << mst_length << std::endl;
     */
-    return packet;
 }
 
-std::vector<uint8_t> TagDSTI::Assemble()
+void TagDSTI::AssembleInto(std::vector<uint8_t>& packet)
 {
-    std::string pack_data("dsti");
-    std::vector<uint8_t> packet(pack_data.begin(), pack_data.end());
-    packet.reserve(256);
-
-    // Placeholder for length
-    packet.push_back(0);
-    packet.push_back(0);
-    packet.push_back(0);
-    packet.push_back(0);
+    const size_t start = begin_tag(packet, "dsti");
 
     uint8_t dfctl = dlfc % 250;
     uint8_t dfcth = dlfc / 250;
@@ -239,27 +210,16 @@ std::vector<uint8_t> TagDSTI::Assemble()
     }
 
     if (rfadf) {
-        for (size_t i = 0; i < rfad.size(); i++) {
-            packet.push_back(rfad[i]);
-        }
+        packet.insert(packet.end(), rfad.begin(), rfad.end());
     }
-    // calculate and update size
-    // remove TAG name and TAG length fields and convert to bits
-    uint32_t taglength = (packet.size() - 8) * 8;
 
-    // write length into packet
-    packet[4] = (taglength >> 24) & 0xFF;
-    packet[5] = (taglength >> 16) & 0xFF;
-    packet[6] = (taglength >> 8) & 0xFF;
-    packet[7] = taglength & 0xFF;
+    end_tag(packet, start);
 
     dlfc = (dlfc+1) % 5000;
 
     /*
     std::cerr << "TagItem dsti, packet.size " << packet.size() << std::endl;
-    std::cerr << "              length " << taglength / 8 << std::endl;
     */
-    return packet;
 }
 
 void TagDSTI::set_edi_time(const std::time_t t, int tai_utc_offset)
@@ -301,20 +261,9 @@ void TagDSTI::set_edi_time(const std::time_t t)
 }
 #endif
 
-std::vector<uint8_t> TagSSm::Assemble()
+void TagSSm::AssembleInto(std::vector<uint8_t>& packet)
 {
-    std::string pack_data("ss");
-    std::vector<uint8_t> packet(pack_data.begin(), pack_data.end());
-    packet.reserve(istd_length + 16);
-
-    packet.push_back((id >> 8) & 0xFF);
-    packet.push_back(id & 0xFF);
-
-    // Placeholder for length
-    packet.push_back(0);
-    packet.push_back(0);
-    packet.push_back(0);
-    packet.push_back(0);
+    const char name[4] = {'s', 's', (char)((id >> 8) & 0xFF), (char)(id & 0xFF)};
 
     if (rfa > 0x1F) {
         throw std::runtime_error("TagSSm: invalid RFA value");
@@ -332,50 +281,32 @@ std::vector<uint8_t> TagSSm::Assemble()
         throw std::runtime_error("TagSSm: invalid stid value");
     }
 
+    const size_t start = begin_tag(packet, name);
+
     uint32_t istc = (rfa << 19) | (tid << 16) | (tidext << 13) | ((crcstf ? 1 : 0) << 12) | stid;
     packet.push_back((istc >> 16) & 0xFF);
     packet.push_back((istc >> 8) & 0xFF);
     packet.push_back(istc & 0xFF);
 
-    for (size_t i = 0; i < istd_length; i++) {
-        packet.push_back(istd_data[i]);
-    }
-
-    // calculate and update size
-    // remove TAG name and TAG length fields and convert to bits
-    uint32_t taglength = (packet.size() - 8) * 8;
+    packet.insert(packet.end(), istd_data, istd_data + istd_length);
 
-    // write length into packet
-    packet[4] = (taglength >> 24) & 0xFF;
-    packet[5] = (taglength >> 16) & 0xFF;
-    packet[6] = (taglength >> 8) & 0xFF;
-    packet[7] = taglength & 0xFF;
+    end_tag(packet, start);
 
     /*
     std::cerr << "TagItem SSm, length " << packet.size() << std::endl;
     std::cerr << "             istd_length " << istd_length << std::endl;
     */
-    return packet;
 }
 
 
-std::vector<uint8_t> TagStarDMY::Assemble()
+void TagStarDMY::AssembleInto(std::vector<uint8_t>& packet)
 {
-    std::string pack_data("*dmy");
-    std::vector<uint8_t> packet(pack_data.begin(), pack_data.end());
-
-    packet.resize(4 + 4 + length_);
-
-    const uint32_t length_bits = length_ * 8;
-
-    packet[4] = (length_bits >> 24) & 0xFF;
-    packet[5] = (length_bits >> 16) & 0xFF;
-    packet[6] = (length_bits >> 8) & 0xFF;
-    packet[7] = length_bits & 0xFF;
+    const size_t start = begin_tag(packet, "*dmy");
 
     // The remaining bytes in the packet are "undefined data"
+    packet.resize(packet.size() + length_);
 
-    return packet;
+    end_tag(packet, start);
 }
 
 TagODRVersion::TagODRVersion(const std::string& version, uint32_t uptime_s) :
@@ -384,32 +315,18 @@ TagODRVersion::TagODRVersion(const std::string& version, uint32_t uptime_s) :
 {
 }
 
-std::vector<uint8_t> TagODRVersion::Assemble()
+void TagODRVersion::AssembleInto(std::vector<uint8_t>& packet)
 {
-    std::string pack_data("ODRv");
-    std::vector<uint8_t> packet(pack_data.begin(), pack_data.end());
-
-    const size_t length = m_version.size() + sizeof(uint32_t);
+    const size_t start = begin_tag(packet, "ODRv");
 
-    packet.resize(4 + 4 + length);
+    packet.insert(packet.end(), m_version.cbegin(), m_version.cend());
 
-    const uint32_t length_bits = length * 8;
+    packet.push_back((m_uptime >> 24) & 0xFF);
+    packet.push_back((m_uptime >> 16) & 0xFF);
+    packet.push_back((m_uptime >> 8) & 0xFF);
+    packet.push_back(m_uptime & 0xFF);
 
-    size_t i = 4;
-    packet[i++] = (length_bits >> 24) & 0xFF;
-    packet[i++] = (length_bits >> 16) & 0xFF;
-    packet[i++] = (length_bits >> 8) & 0xFF;
-    packet[i++] = length_bits & 0xFF;
-
-    copy(m_version.cbegin(), m_version.cend(), packet.begin() + i);
-    i += m_version.size();
-
-    packet[i++] = (m_uptime >> 24) & 0xFF;
-    packet[i++] = (m_uptime >> 16) & 0xFF;
-    packet[i++] = (m_uptime >> 8) & 0xFF;
-    packet[i++] = m_uptime & 0xFF;
-
-    return packet;
+    end_tag(packet, start);
 }
 
 TagODRAudioLevels::TagODRAudioLevels(int16_t audiolevel_left, int16_t audiolevel_right) :
@@ -418,30 +335,17 @@ TagODRAudioLevels::TagODRAudioLevels(int16_t audiolevel_left, int16_t audiolevel
 {
 }
 
-std::vector<uint8_t> TagODRAudioLevels::Assemble()
+void TagODRAudioLevels::AssembleInto(std::vector<uint8_t>& packet)
 {
-    std::string pack_data("ODRa");
-    std::vector<uint8_t> packet(pack_data.begin(), pack_data.end());
-
-    constexpr size_t length = 2*sizeof(int16_t);
-
-    packet.resize(4 + 4 + length);
-
-    const uint32_t length_bits = length * 8;
-
-    size_t i = 4;
-    packet[i++] = (length_bits >> 24) & 0xFF;
-    packet[i++] = (length_bits >> 16) & 0xFF;
-    packet[i++] = (length_bits >> 8) & 0xFF;
-    packet[i++] = length_bits & 0xFF;
+    const size_t start = begin_tag(packet, "ODRa");
 
-    packet[i++] = (m_audio_left >> 8) & 0xFF;
-    packet[i++] = m_audio_left & 0xFF;
+    packet.push_back((m_audio_left >> 8) & 0xFF);
+    packet.push_back(m_audio_left & 0xFF);
 
-    packet[i++] = (m_audio_right >> 8) & 0xFF;
-    packet[i++] = m_audio_right & 0xFF;
+    packet.push_back((m_audio_right >> 8) & 0xFF);
+    packet.push_back(m_audio_right & 0xFF);
 
-    return packet;
+    end_tag(packet, start);
 }
 
 }
@@ -29,7 +29,6 @@
 #include "TagItems.h"
 #include <vector>
 #include <string>
-#include <list>
 #include <cstdint>
 
 namespace edi {
@@ -46,9 +45,13 @@ class TagPacket
 {
     public:
         TagPacket(unsigned int alignment);
-        std::vector<uint8_t> Assemble();
+        std::vector<uint8_t> Assemble() const;
 
-        std::list<TagItem*> tag_items;
+        // Append the TAG packet to the end of buf
+        void AssembleInto(std::vector<uint8_t>& buf) const;
+
+        // Kept between packets, clear() does not free the storage
+        std::vector<TagItem*> tag_items;
 
         std::vector<uint8_t> raw_tagpacket;
 
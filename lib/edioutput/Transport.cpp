@@ -26,6 +26,7 @@
  */
 #include "Transport.h"
 #include <iterator>
+#include <algorithm>
 #include <cmath>
 #include <thread>
 
@@ -33,6 +34,15 @@ using namespace std;
 
 namespace edi {
 
+constexpr std::array<uint32_t, 6> Sender::lateness_bins_us;
+
+// How often the UDP destinations get resolved again, to follow DNS changes
+static const auto RESOLVE_INTERVAL = chrono::minutes(5);
+
+// Failed sends request a resolution at the packet rate, they are
+// served at most this often
+static const auto RESOLVE_ERROR_INTERVAL = chrono::seconds(5);
+
 void configuration_t::print() const
 {
     etiLog.level(info) << "EDI Output";
@@ -71,14 +81,17 @@ Sender::Sender(const configuration_t& conf) :
 
     for (const auto& edi_dest : m_conf.destinations) {
         if (const auto udp_dest = dynamic_pointer_cast<edi::udp_destination_t>(edi_dest)) {
-            auto udp_socket = std::make_shared<Socket::UDPSocket>(udp_dest->source_port);
+            auto udp_sender = make_unique<udp_sender_t>();
+            udp_sender->socket = std::make_shared<Socket::UDPSocket>(udp_dest->source_port);
 
             if (not udp_dest->source_addr.empty()) {
-                udp_socket->setMulticastSource(udp_dest->source_addr.c_str());
-                udp_socket->setMulticastTTL(udp_dest->ttl);
+                udp_sender->socket->setMulticastSource(udp_dest->source_addr.c_str());
+                udp_sender->socket->setMulticastTTL(udp_dest->ttl);
             }
 
-            udp_sockets.emplace(udp_dest.get(), udp_socket);
+            udp_sender->address.resolveUdpDestination(udp_dest->dest_addr, udp_dest->dest_port);
+
+            udp_sockets.emplace(udp_dest.get(), move(udp_sender));
         }
         else if (auto tcp_dest = dynamic_pointer_cast<edi::tcp_server_t>(edi_dest)) {
             auto dispatcher = make_shared<Socket::TCPDataDispatcher>(
@@ -101,11 +114,13 @@ Sender::Sender(const configuration_t& conf) :
     }
 
     if (m_conf.enable_pft) {
-        unique_lock<mutex> lock(m_mutex);
-        m_running = true;
         m_thread = thread(&Sender::run, this);
     }
 
+    if (not udp_sockets.empty()) {
+        m_resolver_thread = thread(&Sender::resolve_udp_destinations, this);
+    }
+
     if (m_conf.verbose) {
         etiLog.log(info, "EDI output set up");
     }
@@ -113,22 +128,23 @@ Sender::Sender(const configuration_t& conf) :
 
 Sender::~Sender()
 {
-    {
-        unique_lock<mutex> lock(m_mutex);
-        m_running = false;
-    }
-
     if (m_thread.joinable()) {
+        m_batch_queue.trigger_wakeup();
         m_thread.join();
     }
+
+    if (m_resolver_thread.joinable()) {
+        m_resolve_requests.trigger_wakeup();
+        m_resolver_thread.join();
+    }
 }
 
 void Sender::write(const TagPacket& tagpacket)
 {
     // Assemble into one AF Packet
-    edi::AFPacket af_packet = edi_afPacketiser.Assemble(tagpacket);
+    edi_afPacketiser.Assemble(tagpacket, m_af_packet);
 
-    write(af_packet);
+    write(m_af_packet);
 }
 
 void Sender::write(const AFPacket& af_packet)
@@ -156,16 +172,12 @@ void Sender::write(const AFPacket& af_packet)
             }
         }
 
-        /* Separate insertion into map and transmission so as to make spreading possible */
-        const auto now = steady_clock::now();
-        {
-            auto tp = now;
-            unique_lock<mutex> lock(m_mutex);
-            for (auto& edi_frag : edi_fragments) {
-                m_pending_frames[tp] = move(edi_frag);
-                tp += inter_fragment_wait_time;
-            }
-        }
+        /* Separate scheduling and transmission so as to make spreading possible */
+        fragment_batch_t batch;
+        batch.start = steady_clock::now();
+        batch.interval = inter_fragment_wait_time;
+        batch.fragments = move(edi_fragments);
+        m_batch_queue.push(move(batch));
 
         // Transmission done in run() function
     }
@@ -178,16 +190,14 @@ void Sender::write(const AFPacket& af_packet)
 
         for (auto& dest : m_conf.destinations) {
             if (const auto& udp_dest = dynamic_pointer_cast<edi::udp_destination_t>(dest)) {
-                Socket::InetAddress addr;
-                addr.resolveUdpDestination(udp_dest->dest_addr, udp_dest->dest_port);
-
                 if (af_packet.size() > 1400 and not m_udp_fragmentation_warning_printed) {
                     fprintf(stderr, "EDI Output: AF packet larger than 1400,"
                             " consider using PFT to avoid UP fragmentation.\n");
                     m_udp_fragmentation_warning_printed = true;
                 }
 
-                udp_sockets.at(udp_dest.get())->send(af_packet, addr);
+                send_udp(*udp_dest, *udp_sockets.at(udp_dest.get()),
+                        af_packet.data(), af_packet.size());
             }
             else if (auto tcp_dest = dynamic_pointer_cast<edi::tcp_server_t>(dest)) {
                 tcp_dispatchers.at(tcp_dest.get())->write(af_packet);
@@ -212,48 +222,179 @@ void Sender::override_pft_sequence(uint16_t pseq)
     edi_pft.OverridePSeq(pseq);
 }
 
-void Sender::run()
+Sender::spreading_stats_t Sender::get_spreading_stats() const
 {
-    while (m_running) {
-        unique_lock<mutex> lock(m_mutex);
-        const auto now = chrono::steady_clock::now();
+    spreading_stats_t stats;
+    stats.num_sent = m_num_sent_fragments.load(memory_order_relaxed);
+    for (size_t i = 0; i < m_lateness_histogram.size(); i++) {
+        stats.lateness_histogram[i] = m_lateness_histogram[i].load(memory_order_relaxed);
+    }
+    return stats;
+}
 
-        // Send over ethernet
-        for (auto it = m_pending_frames.begin(); it != m_pending_frames.end(); ) {
-            const auto& edi_frag = it->second;
+void Sender::send_fragment(const edi::PFTFragment& edi_frag)
+{
+    if (m_conf.dump) {
+        ostream_iterator<uint8_t> debug_iterator(edi_debug_file);
+        copy(edi_frag.begin(), edi_frag.end(), debug_iterator);
+    }
+
+    for (auto& dest : m_conf.destinations) {
+        if (const auto& udp_dest = dynamic_pointer_cast<edi::udp_destination_t>(dest)) {
+            send_udp(*udp_dest, *udp_sockets.at(udp_dest.get()),
+                    edi_frag.data(), edi_frag.size());
+        }
+        else if (auto tcp_dest = dynamic_pointer_cast<edi::tcp_server_t>(dest)) {
+            // The TCP senders queue their own copy
+            tcp_dispatchers.at(tcp_dest.get())->write(
+                    vector<uint8_t>(edi_frag.begin(), edi_frag.end()));
+        }
+        else if (auto tcp_dest = dynamic_pointer_cast<edi::tcp_client_t>(dest)) {
+            tcp_senders.at(tcp_dest.get())->sendall(
+                    vector<uint8_t>(edi_frag.begin(), edi_frag.end()));
+        }
+        else {
+            throw logic_error("EDI destination not implemented");
+        }
+    }
+}
+
+void Sender::send_udp(const udp_destination_t& udp_dest, udp_sender_t& udp_sender,
+        const uint8_t *data, size_t size)
+{
+    Socket::InetAddress addr;
+    {
+        unique_lock<mutex> lock(udp_sender.address_mutex);
+        addr = udp_sender.address;
+    }
 
-            if (it->first <= now) {
-                if (m_conf.dump) {
-                    ostream_iterator<uint8_t> debug_iterator(edi_debug_file);
-                    copy(edi_frag.begin(), edi_frag.end(), debug_iterator);
+    try {
+        udp_sender.socket->send(data, size, addr);
+
+        if (udp_sender.send_failed) {
+            etiLog.level(info) << "EDI Output: sending to " << udp_dest.dest_addr <<
+                ":" << udp_dest.dest_port << " works again";
+            udp_sender.send_failed = false;
+        }
+    }
+    catch (const runtime_error& e) {
+        // Log only the first failure, and let the resolver check if
+        // the destination has moved
+        if (not udp_sender.send_failed) {
+            etiLog.level(warn) << "EDI Output: sending to " << udp_dest.dest_addr <<
+                ":" << udp_dest.dest_port << " failed: " << e.what();
+            udp_sender.send_failed = true;
+        }
+        m_resolve_requests.push(true, 1);
+    }
+}
+
+void Sender::resolve_udp_destinations()
+{
+    using namespace std::chrono;
+
+    // The constructor resolved all destinations
+    auto last_resolve = steady_clock::now();
+
+    bool request = false;
+    while (true) {
+        try {
+            const bool requested = m_resolve_requests.wait_and_pop_until(request,
+                    last_resolve + RESOLVE_INTERVAL);
+
+            if (requested) {
+                // Swallow the requests that arrive in the meantime
+                const auto earliest = last_resolve + RESOLVE_ERROR_INTERVAL;
+                while (steady_clock::now() < earliest) {
+                    m_resolve_requests.wait_and_pop_until(request, earliest);
                 }
+            }
+        }
+        catch (const ThreadsafeQueueWakeup&) {
+            break;
+        }
+
+        last_resolve = steady_clock::now();
 
-                for (auto& dest : m_conf.destinations) {
-                    if (const auto& udp_dest = dynamic_pointer_cast<edi::udp_destination_t>(dest)) {
-                        Socket::InetAddress addr;
-                        addr.resolveUdpDestination(udp_dest->dest_addr, udp_dest->dest_port);
-
-                        udp_sockets.at(udp_dest.get())->send(edi_frag, addr);
-                    }
-                    else if (auto tcp_dest = dynamic_pointer_cast<edi::tcp_server_t>(dest)) {
-                        tcp_dispatchers.at(tcp_dest.get())->write(edi_frag);
-                    }
-                    else if (auto tcp_dest = dynamic_pointer_cast<edi::tcp_client_t>(dest)) {
-                        tcp_senders.at(tcp_dest.get())->sendall(edi_frag);
-                    }
-                    else {
-                        throw logic_error("EDI destination not implemented");
-                    }
+        for (auto& us : udp_sockets) {
+            const auto udp_dest = us.first;
+            auto& udp_sender = *us.second;
+
+            Socket::InetAddress addr;
+            try {
+                addr.resolveUdpDestination(udp_dest->dest_addr, udp_dest->dest_port);
+            }
+            catch (const runtime_error& e) {
+                // Keep sending to the previous address, and log only the
+                // first failure
+                if (not udp_sender.resolve_failed) {
+                    etiLog.level(warn) << "EDI Output: cannot resolve " << udp_dest->dest_addr <<
+                        ": " << e.what();
+                    udp_sender.resolve_failed = true;
                 }
-                it = m_pending_frames.erase(it);
+                continue;
+            }
+
+            if (udp_sender.resolve_failed) {
+                etiLog.level(info) << "EDI Output: " << udp_dest->dest_addr << " resolves again";
+                udp_sender.resolve_failed = false;
+            }
+
+            unique_lock<mutex> lock(udp_sender.address_mutex);
+            udp_sender.address = addr;
+        }
+    }
+}
+
+void Sender::run()
+{
+    using namespace std::chrono;
+
+    fragment_batch_t batch;
+
+    while (true) {
+        // Send over ethernet all fragments that are due
+        while (not m_pending_frames.empty()) {
+            const auto& pending = m_pending_frames.top();
+            const auto now = steady_clock::now();
+            if (pending.deadline > now) {
+                break;
+            }
+
+            const uint64_t late_us = duration_cast<microseconds>(now - pending.deadline).count();
+            const size_t bin = upper_bound(lateness_bins_us.begin(), lateness_bins_us.end(), late_us) -
+                lateness_bins_us.begin();
+            m_lateness_histogram[bin].fetch_add(1, memory_order_relaxed);
+            m_num_sent_fragments.fetch_add(1, memory_order_relaxed);
+
+            send_fragment(pending.fragment);
+            m_pending_frames.pop();
+        }
+
+        // Sleep until the next fragment is due, or new ones get scheduled
+        bool batch_received = false;
+        try {
+            if (m_pending_frames.empty()) {
+                m_batch_queue.wait_and_pop(batch);
+                batch_received = true;
             }
             else {
-                ++it;
+                batch_received = m_batch_queue.wait_and_pop_until(
+                        batch, m_pending_frames.top().deadline);
             }
         }
+        catch (const ThreadsafeQueueWakeup&) {
+            break;
+        }
 
-        lock.unlock();
-        this_thread::sleep_for(chrono::microseconds(500));
+        if (batch_received) {
+            auto tp = batch.start;
+            for (auto& edi_frag : batch.fragments) {
+                m_pending_frames.push({tp, m_next_fragment_seq++, move(edi_frag)});
+                tp += batch.interval;
+            }
+            batch.fragments.clear();
+        }
     }
 }
 
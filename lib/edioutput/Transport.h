@@ -31,9 +31,12 @@
 #include "AFPacket.h"
 #include "PFT.h"
 #include "Socket.h"
+#include "ThreadsafeQueue.h"
 #include <vector>
+#include <array>
+#include <atomic>
 #include <chrono>
-#include <map>
+#include <queue>
 #include <unordered_map>
 #include <stdexcept>
 #include <fstream>
@@ -66,9 +69,69 @@ class Sender {
         void override_af_sequence(uint16_t seq);
         void override_pft_sequence(uint16_t pseq);
 
+        // Upper bounds of the bins of the lateness histogram, the last bin
+        // holds everything above the last bound
+        static constexpr std::array<uint32_t, 6> lateness_bins_us = {
+            50, 100, 200, 500, 1000, 2000 };
+
+        struct spreading_stats_t {
+            // Number of PFT fragments sent by the spreading thread
+            uint64_t num_sent = 0;
+
+            // Difference between the time a fragment was sent and the time
+            // it was scheduled for
+            std::array<uint64_t, lateness_bins_us.size() + 1> lateness_histogram = {};
+        };
+
+        spreading_stats_t get_spreading_stats() const;
+
     private:
         void run();
 
+        // A PFT fragment waiting for its transmission time
+        struct pending_fragment_t {
+            std::chrono::steady_clock::time_point deadline;
+            // Keeps fragments with the same deadline in order
+            uint64_t seq;
+            edi::PFTFragment fragment;
+
+            bool operator>(const pending_fragment_t& other) const {
+                return deadline != other.deadline ?
+                    deadline > other.deadline : seq > other.seq;
+            }
+        };
+
+        // All fragments of one AF packet, and when to send them
+        struct fragment_batch_t {
+            std::chrono::steady_clock::time_point start;
+            std::chrono::microseconds interval;
+            std::vector<edi::PFTFragment> fragments;
+        };
+
+        void send_fragment(const edi::PFTFragment& edi_frag);
+
+        // A UDP socket and the address its destination currently resolves to
+        struct udp_sender_t {
+            std::shared_ptr<Socket::UDPSocket> socket;
+
+            // Protects address, which the resolver thread updates
+            std::mutex address_mutex;
+            Socket::InetAddress address;
+
+            // Only accessed by the thread sending the packets
+            bool send_failed = false;
+
+            // Only accessed by the resolver thread
+            bool resolve_failed = false;
+        };
+
+        void send_udp(const udp_destination_t& udp_dest, udp_sender_t& udp_sender,
+                const uint8_t *data, size_t size);
+
+        // Resolve the UDP destinations again periodically, and when
+        // sending fails, without holding up transmission
+        void resolve_udp_destinations();
+
         bool m_udp_fragmentation_warning_printed = false;
 
         configuration_t m_conf;
@@ -77,19 +140,34 @@ class Sender {
         // The TagPacket will then be placed into an AFPacket
         edi::AFPacketiser edi_afPacketiser;
 
+        // Reused for every AF packet to avoid allocations
+        edi::AFPacket m_af_packet;
+
         // The AF Packet will be protected with reed-solomon and split in fragments
         edi::PFT edi_pft;
 
-        std::unordered_map<udp_destination_t*, std::shared_ptr<Socket::UDPSocket>> udp_sockets;
+        std::unordered_map<udp_destination_t*, std::unique_ptr<udp_sender_t>> udp_sockets;
         std::unordered_map<tcp_server_t*, std::shared_ptr<Socket::TCPDataDispatcher>> tcp_dispatchers;
         std::unordered_map<tcp_client_t*, std::shared_ptr<Socket::TCPSendClient>> tcp_senders;
 
         // PFT spreading requires sending UDP packets at specific time, independently of
-        // time when write() gets called
+        // time when write() gets called. write() hands the fragments over
+        // through the queue, the thread keeps them ordered by deadline and
+        // sleeps until the earliest one is due.
         std::thread m_thread;
-        std::mutex m_mutex;
-        bool m_running = false;
-        std::map<std::chrono::steady_clock::time_point, edi::PFTFragment> m_pending_frames;
+        ThreadsafeQueue<fragment_batch_t> m_batch_queue;
+
+        // Only accessed by the thread
+        std::priority_queue<pending_fragment_t,
+            std::vector<pending_fragment_t>,
+            std::greater<pending_fragment_t> > m_pending_frames;
+        uint64_t m_next_fragment_seq = 0;
+
+        std::thread m_resolver_thread;
+        ThreadsafeQueue<bool> m_resolve_requests;
+
+        std::atomic<uint64_t> m_num_sent_fragments{0};
+        std::array<std::atomic<uint64_t>, lateness_bins_us.size() + 1> m_lateness_histogram = {};
 
         size_t m_last_num_pft_fragments = 0;
 };
@@ -22,6 +22,94 @@
 #include "AACDecoder.h"
 #include <stdexcept>
 #include <string>
+#include <algorithm>
+#include <ctime>
+#include <chrono>
+#include <cmath>
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#  include <arm_neon.h>
+#endif
+
+/* Measure the absolute peak and the sum of squares of interleaved stereo
+ * samples. num_samples counts the samples of both channels, and must be even.
+ */
+static void measure_levels(const int16_t *samples, size_t num_samples,
+        int16_t peak[2], uint64_t sum_sq[2])
+{
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    // Keeps the samples of the left channel, at the even positions
+    const __m128i mask_left = _mm_set1_epi32(0x0000FFFF);
+    __m128i vpeak = zero;
+    __m128i vsum_left = zero;
+    __m128i vsum_right = zero;
+
+    for (; i + 8 <= num_samples; i += 8) {
+        const __m128i x = _mm_loadu_si128((const __m128i*)(samples + i));
+
+        // |x|, saturating -32768 to 32767
+        vpeak = _mm_max_epi16(vpeak, _mm_max_epi16(x, _mm_subs_epi16(zero, x)));
+
+        // Each 32-bit lane holds the square of one sample, below 2^31
+        const __m128i sq_left = _mm_madd_epi16(x, _mm_and_si128(x, mask_left));
+        const __m128i sq_right = _mm_madd_epi16(x, _mm_andnot_si128(mask_left, x));
+        vsum_left = _mm_add_epi64(vsum_left, _mm_unpacklo_epi32(sq_left, zero));
+        vsum_left = _mm_add_epi64(vsum_left, _mm_unpackhi_epi32(sq_left, zero));
+        vsum_right = _mm_add_epi64(vsum_right, _mm_unpacklo_epi32(sq_right, zero));
+        vsum_right = _mm_add_epi64(vsum_right, _mm_unpackhi_epi32(sq_right, zero));
+    }
+
+    int16_t p[8];
+    uint64_t sl[2], sr[2];
+    _mm_storeu_si128((__m128i*)p, vpeak);
+    _mm_storeu_si128((__m128i*)sl, vsum_left);
+    _mm_storeu_si128((__m128i*)sr, vsum_right);
+    for (size_t j = 0; j < 8; j += 2) {
+        peak[0] = std::max(peak[0], p[j]);
+        peak[1] = std::max(peak[1], p[j+1]);
+    }
+    sum_sq[0] += sl[0] + sl[1];
+    sum_sq[1] += sr[0] + sr[1];
+#elif defined(__ARM_NEON)
+    int16x8_t vpeak = vdupq_n_s16(0);
+    uint64x2_t vsum_left = vdupq_n_u64(0);
+    uint64x2_t vsum_right = vdupq_n_u64(0);
+
+    for (; i + 8 <= num_samples; i += 8) {
+        // Deinterleave into left and right channels
+        const int16x4x2_t x = vld2_s16(samples + i);
+        const int16x8_t both = vcombine_s16(x.val[0], x.val[1]);
+        vpeak = vmaxq_s16(vpeak, vqabsq_s16(both));
+
+        const int32x4_t sq_left = vmull_s16(x.val[0], x.val[0]);
+        const int32x4_t sq_right = vmull_s16(x.val[1], x.val[1]);
+        vsum_left = vpadalq_u32(vsum_left, vreinterpretq_u32_s32(sq_left));
+        vsum_right = vpadalq_u32(vsum_right, vreinterpretq_u32_s32(sq_right));
+    }
+
+    int16_t p[8];
+    vst1q_s16(p, vpeak);
+    for (size_t j = 0; j < 4; j++) {
+        peak[0] = std::max(peak[0], p[j]);
+        peak[1] = std::max(peak[1], p[j+4]);
+    }
+    sum_sq[0] += vgetq_lane_u64(vsum_left, 0) + vgetq_lane_u64(vsum_left, 1);
+    sum_sq[1] += vgetq_lane_u64(vsum_right, 0) + vgetq_lane_u64(vsum_right, 1);
+#endif
+
+    for (; i + 2 <= num_samples; i += 2) {
+        for (size_t ch = 0; ch < 2; ch++) {
+            const int32_t x = samples[i + ch];
+            const int16_t a = std::min(std::abs(x), 32767);
+            peak[ch] = std::max(peak[ch], a);
+            sum_sq[ch] += x * x;
+        }
+    }
+}
 
 AACDecoder::AACDecoder()
 {
@@ -38,109 +126,155 @@ AACDecoder::~AACDecoder()
     }
 }
 
-void AACDecoder::decode_frame(uint8_t *data, size_t len)
+AACDecoder::DecodeStatus AACDecoder::configure(uint8_t audio_format)
 {
-    const bool dac_rate             = data[2] & 0x40;
-    const bool sbr_flag             = data[2] & 0x20;
-    const bool aac_channel_mode     = data[2] & 0x10;
-    const bool ps_flag              = data[2] & 0x08;
-    //const uint8_t mpeg_surround_config = data[2] & 0x07;
+    const bool dac_rate             = audio_format & 0x40;
+    const bool sbr_flag             = audio_format & 0x20;
+    const bool aac_channel_mode     = audio_format & 0x10;
+    const bool ps_flag              = audio_format & 0x08;
 
     const int core_sr_index = dac_rate ?
         (sbr_flag ? 6 : 3) : (sbr_flag ? 8 : 5);   // 24/48/16/32 kHz
     const int core_ch_config = aac_channel_mode ? 2 : 1;
     const int extension_sr_index = dac_rate ? 3 : 5;    // 48/32 kHz
 
-    int au_start[6] = {};
+    const auto time_start = std::chrono::steady_clock::now();
 
-    int num_aus = dac_rate ? (sbr_flag ? 3 : 6) : (sbr_flag ? 2 : 4);
-    au_start[0] = dac_rate ? (sbr_flag ? 6 : 11) : (sbr_flag ? 5 : 8);
-    au_start[1] = data[3] << 4 | data[4] >> 4;
+    std::vector<uint8_t> asc;
 
-    if (num_aus >= 3) {
-        au_start[2] = (data[4] & 0x0F) << 8 | data[5];
-    }
+    // AAC LC
+    asc.push_back(0b00010 << 3 | core_sr_index >> 1);
+    asc.push_back((core_sr_index & 0x01) << 7 | core_ch_config << 3 | 0b100);
 
-    if (num_aus >= 4) {
-        au_start[3] = data[6] << 4 | data[7] >> 4;
-    }
+    if (sbr_flag) {
+        // add SBR
+        asc.push_back(0x56);
+        asc.push_back(0xE5);
+        asc.push_back(0x80 | (extension_sr_index << 3));
 
-    if (num_aus == 6) {
-        au_start[4] = (data[7] & 0x0F) << 8 | data[8];
-        au_start[5] = data[9] << 4 | data[10] >> 4;
+        if (ps_flag) {
+            // add PS
+            asc.back() |= 0x05;
+            asc.push_back(0x48);
+            asc.push_back(0x80);
+        }
     }
 
-    au_start[num_aus] = len; // end of the buffer
+    uint8_t* asc_array[1] {asc.data()};
+    const unsigned int asc_sizeof_array[1] {(unsigned int) asc.size()};
 
-    for (int i = 0; i < num_aus; i++) {
-        if (au_start[i] >= au_start[i+1]) {
-            throw std::runtime_error("  AU ordering check failed\n");
-        }
+    AAC_DECODER_ERROR init_result = aacDecoder_ConfigRaw(m_handle,
+            asc_array, asc_sizeof_array);
+    if (init_result != AAC_DEC_OK) {
+        // Try again with the next superframe
+        m_decoder_set_up = false;
+        m_errors.config_failed++;
+        m_last_fdk_error = init_result;
+        return DecodeStatus::ConfigFailed;
     }
 
-    if (not m_decoder_set_up) {
-        std::vector<uint8_t> asc;
+    m_channels = (aac_channel_mode or ps_flag) ? 2 : 1;
+    size_t output_frame_len = 960 * 2 * m_channels * (sbr_flag ? 2 : 1);
+    m_output_frame.resize(output_frame_len);
+    fprintf(stderr, "  Setting decoder output frame len %zu\n", output_frame_len);
 
-        // AAC LC
-        asc.push_back(0b00010 << 3 | core_sr_index >> 1);
-        asc.push_back((core_sr_index & 0x01) << 7 | core_ch_config << 3 | 0b100);
+    // The loudness of the previous audio mode doesn't apply any more
+    const int sample_rate = dac_rate ? 48000 : 32000;
+    m_loudness.reset(sample_rate, m_channels);
+    m_sample_rate = sample_rate;
 
-        if (sbr_flag) {
-            // add SBR
-            asc.push_back(0x56);
-            asc.push_back(0xE5);
-            asc.push_back(0x80 | (extension_sr_index << 3));
+    if (m_decoder_set_up) {
+        m_config.num_reconfigurations++;
+    }
+    m_decoder_set_up = true;
+    m_audio_format = audio_format;
 
-            if (ps_flag) {
-                // add PS
-                asc.back() |= 0x05;
-                asc.push_back(0x48);
-                asc.push_back(0x80);
-            }
-        }
+    using namespace std::chrono;
+    m_config.config_time_ms =
+        duration_cast<microseconds>(steady_clock::now() - time_start).count() / 1000.0;
+
+    fprintf(stderr, "  Set up decoder with %d Hz, %s%swith %d channels in %.3f ms\n",
+            sample_rate, (sbr_flag ? "SBR " : ""), (ps_flag ? "PS " : ""),
+            m_channels, m_config.config_time_ms);
 
-        uint8_t* asc_array[1] {asc.data()};
-        const unsigned int asc_sizeof_array[1] {(unsigned int) asc.size()};
+    return DecodeStatus::Ok;
+}
 
-        AAC_DECODER_ERROR init_result = aacDecoder_ConfigRaw(m_handle,
-                asc_array, asc_sizeof_array);
-        if (init_result != AAC_DEC_OK) {
-            throw std::runtime_error(
-                    "AACDecoderFDKAAC: error while aacDecoder_ConfigRaw: " +
-                    std::to_string(init_result));
+AACDecoder::DecodeStatus AACDecoder::decode_frame(uint8_t *data, size_t len, bool discontinuity,
+        uint32_t au_valid, uint64_t frame_seq, const std::chrono::system_clock::time_point& ts)
+{
+    superframe_aus_t aus;
+    if (not superframe_get_aus(data, len, aus)) {
+        m_errors.invalid_header++;
+        return DecodeStatus::InvalidHeader;
+    }
+    const int num_aus = aus.num_aus;
+    const int *au_start = aus.au_start;
+
+    // The encoder can change the audio mode at any time, the MPEG
+    // Surround config is ignored.
+    const uint8_t audio_format = data[2] & 0x78;
+    if (not m_decoder_set_up or audio_format != m_audio_format) {
+        const auto config_status = configure(audio_format);
+        if (config_status != DecodeStatus::Ok) {
+            return config_status;
         }
+        discontinuity = true;
+    }
 
-        m_channels = (aac_channel_mode or ps_flag) ? 2 : 1;
-        size_t output_frame_len = 960 * 2 * m_channels * (sbr_flag ? 2 : 1);
-        m_output_frame.resize(output_frame_len);
-        fprintf(stderr, "  Setting decoder output frame len %zu\n", output_frame_len);
+    DecodeStatus status = DecodeStatus::Ok;
 
-        const int sample_rate = dac_rate ? 48000 : 32000;
-        m_decoder_set_up = true;
+    for (int i = 0; i < num_aus; i++) {
+        // Tell FDK to resynchronise instead of continuing from the
+        // previous superframe
+        const unsigned int flags = (i == 0 and discontinuity) ? AACDEC_INTR : 0;
 
-        fprintf(stderr, "  Set up decoder with %d Hz, %s%swith %d channels\n",
-                sample_rate, (sbr_flag ? "SBR " : ""), (ps_flag ? "PS " : ""),
-                m_channels);
+        DecodeStatus au_status = DecodeStatus::InvalidAU;
+        if (au_valid & (1 << i)) {
+            uint8_t *au_data = data + au_start[i];
+            size_t au_len = au_start[i+1] - au_start[i] - AU_CRCLEN;
+            au_status = decode_au(au_data, au_len, flags);
+        }
 
-    }
+        bool pcm_valid = true;
+        if (au_status != DecodeStatus::Ok) {
+            // Let FDK conceal the AU, so that it stays in step with the stream
+            pcm_valid = conceal_au(flags);
+            if (status == DecodeStatus::Ok) {
+                status = au_status;
+            }
+        }
 
-    const size_t AU_CRCLEN = 2;
-    for (int i = 0; i < num_aus; i++) {
-        uint8_t *au_data = data + au_start[i];
-        size_t au_len = au_start[i+1] - au_start[i] - AU_CRCLEN;
-        decode_au(au_data, au_len);
+        if (m_pcm_tap and pcm_valid) {
+            // The AUs evenly divide the 120ms of the superframe
+            const auto au_offset = std::chrono::microseconds(120000 * i / num_aus);
+            m_pcm_tap->write(m_output_frame.data(), m_output_frame.size(),
+                    frame_seq, i, au_status != DecodeStatus::Ok, ts + au_offset,
+                    m_sample_rate, m_channels);
+        }
     }
+
+    return status;
 }
 
 AACDecoder::peak_t AACDecoder::get_peaks()
 {
-    auto p = m_peak;
-    m_peak.peak_left = 0;
-    m_peak.peak_right = 0;
+    peak_t p;
+    p.peak_left = m_peak[0];
+    p.peak_right = m_peak[1];
+
+    if (m_num_samples > 0) {
+        p.rms_left = std::lround(std::sqrt((double)m_sum_sq[0] / m_num_samples));
+        p.rms_right = std::lround(std::sqrt((double)m_sum_sq[1] / m_num_samples));
+    }
+
+    m_peak[0] = m_peak[1] = 0;
+    m_sum_sq[0] = m_sum_sq[1] = 0;
+    m_num_samples = 0;
     return p;
 }
 
-void AACDecoder::decode_au(uint8_t *data, size_t len)
+AACDecoder::DecodeStatus AACDecoder::decode_au(uint8_t *data, size_t len, unsigned int flags)
 {
     uint8_t* input_buffer[1] {data};
     const unsigned int input_buffer_size[1] {(unsigned int) len};
@@ -150,31 +284,198 @@ void AACDecoder::decode_au(uint8_t *data, size_t len)
     AAC_DECODER_ERROR result = aacDecoder_Fill(
             m_handle, input_buffer, input_buffer_size, &bytes_valid);
 
-    if (result != AAC_DEC_OK) {
-        throw std::runtime_error(
-                "AACDecoderFDKAAC: error while aacDecoder_Fill: " +
-                std::to_string(result));
-    }
-
-    if (bytes_valid) {
-        throw std::runtime_error(
-                "AACDecoderFDKAAC: aacDecoder_Fill did not consume all bytes");
+    if (result != AAC_DEC_OK or bytes_valid) {
+        // bytes_valid tells us that not all bytes were consumed
+        m_errors.fill_failed++;
+        m_last_fdk_error = result;
+        return DecodeStatus::FillFailed;
     }
 
     // decode audio
     result = aacDecoder_DecodeFrame(m_handle,
-            (short int*)m_output_frame.data(), m_output_frame.size(), 0);
+            (short int*)m_output_frame.data(), m_output_frame.size(), flags);
     if (result != AAC_DEC_OK) {
-        throw std::runtime_error(
-                "AACDecoderFDKAAC: error while aacDecoder_DecodeFrame: " +
-                std::to_string(result));
+        m_errors.decode_failed++;
+        m_last_fdk_error = result;
+        return DecodeStatus::DecodeFailed;
+    }
+
+    measure(reinterpret_cast<const int16_t*>(m_output_frame.data()),
+            m_output_frame.size() / sizeof(int16_t));
+    return DecodeStatus::Ok;
+}
+
+bool AACDecoder::conceal_au(unsigned int flags)
+{
+    m_errors.concealed++;
+
+    // The concealed audio is not measured, it is an estimate
+    return aacDecoder_DecodeFrame(m_handle, (short int*)m_output_frame.data(),
+            m_output_frame.size(), flags | AACDEC_CONCEAL) == AAC_DEC_OK;
+}
+
+void AACDecoder::measure(const int16_t *samples, size_t num_samples)
+{
+    m_loudness.process(samples, num_samples);
+
+    if (m_channels == 2) {
+        measure_levels(samples, num_samples, m_peak, m_sum_sq);
+        m_num_samples += num_samples / 2;
+    }
+    else {
+        // Measure pairs of mono samples, and merge the two halves
+        int16_t peak[2] = {m_peak[0], m_peak[0]};
+        uint64_t sum_sq[2] = {0, 0};
+        measure_levels(samples, num_samples, peak, sum_sq);
+        m_peak[0] = m_peak[1] = std::max(peak[0], peak[1]);
+        m_sum_sq[0] += sum_sq[0] + sum_sq[1];
+        m_sum_sq[1] = m_sum_sq[0];
+        m_num_samples += num_samples;
+    }
+}
+
+// Number of superframes that can wait for the decoder thread
+static const size_t MAX_QUEUED_FRAMES = 4;
+
+// Minimum interval between two decoding error messages
+static const auto ERROR_LOG_INTERVAL = std::chrono::seconds(10);
+
+AACDecoderThread::AACDecoderThread() :
+    m_thread(&AACDecoderThread::process, this)
+{ }
+
+AACDecoderThread::~AACDecoderThread()
+{
+    m_queue.trigger_wakeup();
+    m_thread.join();
+}
+
+void AACDecoderThread::set_interval(unsigned int interval)
+{
+    m_interval = interval;
+}
+
+void AACDecoderThread::push_frame(const uint8_t *data, size_t len, uint32_t au_valid,
+        const std::chrono::system_clock::time_point& ts)
+{
+    m_num_pushed++;
+    if (m_interval == 0 or m_num_pushed % m_interval != 0) {
+        return;
     }
 
-    for (size_t i = 0; i < m_output_frame.size(); i+=4) {
-        const uint8_t *input_buf = m_output_frame.data();
-        int16_t l = input_buf[i] | (input_buf[i+1] << 8);
-        int16_t r = input_buf[i+2] | (input_buf[i+3] << 8);
-        m_peak.peak_left  = std::max(m_peak.peak_left,  l);
-        m_peak.peak_right = std::max(m_peak.peak_right, r);
+    // Reuse the buffer of a superframe the thread has decoded, so that
+    // the buffers cycle instead of being allocated for every superframe
+    frame_t frame;
+    m_free_buffers.try_pop(frame.data);
+    frame.data.assign(data, data + len);
+    frame.seq = m_num_pushed;
+    frame.au_valid = au_valid;
+    frame.ts = ts;
+
+    const auto r = m_queue.push_overflow(std::move(frame), MAX_QUEUED_FRAMES);
+    if (r.overflowed) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_levels.num_dropped++;
+    }
+}
+
+AACDecoderThread::levels_t AACDecoderThread::get_levels()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto l = m_levels;
+    l.age = m_num_pushed - m_levels_seq;
+    m_levels_read = true;
+    return l;
+}
+
+static double thread_cpu_time()
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return 0;
+    }
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char* status_to_string(AACDecoder::DecodeStatus status)
+{
+    using S = AACDecoder::DecodeStatus;
+    switch (status) {
+        case S::Ok: return "ok";
+        case S::InvalidHeader: return "invalid superframe header";
+        case S::ConfigFailed: return "aacDecoder_ConfigRaw failed";
+        case S::InvalidAU: return "invalid AU";
+        case S::FillFailed: return "aacDecoder_Fill failed";
+        case S::DecodeFailed: return "aacDecoder_DecodeFrame failed";
+    }
+    return "unknown";
+}
+
+void AACDecoderThread::process()
+{
+    uint64_t last_seq = 0;
+
+    // Decoding errors since the last time they were logged
+    size_t num_failed = 0;
+    std::chrono::steady_clock::time_point first_failure;
+    AACDecoder::DecodeStatus last_status = AACDecoder::DecodeStatus::Ok;
+
+    while (true) {
+        frame_t frame;
+        try {
+            m_queue.wait_and_pop(frame);
+        }
+        catch (const ThreadsafeQueueWakeup&) {
+            break;
+        }
+
+        // Superframes were skipped or dropped since the last one we decoded
+        const bool discontinuity = frame.seq != last_seq + 1;
+        last_seq = frame.seq;
+
+        const auto status = m_decoder.decode_frame(frame.data.data(), frame.data.size(),
+                discontinuity, frame.au_valid, frame.seq, frame.ts);
+        m_free_buffers.push(std::move(frame.data), MAX_QUEUED_FRAMES);
+        const auto p = m_decoder.get_peaks();
+
+        if (status != AACDecoder::DecodeStatus::Ok) {
+            if (num_failed == 0) {
+                first_failure = std::chrono::steady_clock::now();
+            }
+            num_failed++;
+            last_status = status;
+        }
+
+        // Summarise the errors instead of logging every failed superframe
+        if (num_failed > 0 and
+                std::chrono::steady_clock::now() - first_failure >= ERROR_LOG_INTERVAL) {
+            fprintf(stderr, "AAC decoding failed for %zu superframes, last error: %s (FDK 0x%x)\n",
+                    num_failed, status_to_string(last_status),
+                    (unsigned int)m_decoder.get_last_fdk_error());
+            num_failed = 0;
+        }
+
+        const auto loudness = m_decoder.get_loudness();
+        const auto errors = m_decoder.get_errors();
+        const auto config = m_decoder.get_config();
+        const double cpu_time = thread_cpu_time();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_levels_read) {
+            m_levels.peaks = p;
+            m_levels_read = false;
+        }
+        else {
+            // Keep the highest levels until they are read
+            m_levels.peaks.peak_left = std::max(m_levels.peaks.peak_left, p.peak_left);
+            m_levels.peaks.peak_right = std::max(m_levels.peaks.peak_right, p.peak_right);
+            m_levels.peaks.rms_left = std::max(m_levels.peaks.rms_left, p.rms_left);
+            m_levels.peaks.rms_right = std::max(m_levels.peaks.rms_right, p.rms_right);
+        }
+        m_levels_seq = frame.seq;
+        m_levels.cpu_time = cpu_time;
+        m_levels.loudness = loudness;
+        m_levels.errors = errors;
+        m_levels.config = config;
     }
 }
@@ -26,9 +26,17 @@
 #pragma once
 
 #include <fdk-aac/aacdecoder_lib.h>
+#include "ThreadsafeQueue.h"
+#include "LoudnessMeter.h"
+#include "SuperframeCheck.h"
+#include "PCMTap.h"
 #include <cstdint>
 #include <cstddef>
 #include <vector>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <mutex>
 
 class AACDecoder {
     public:
@@ -36,19 +44,178 @@ class AACDecoder {
         ~AACDecoder();
         AACDecoder(const AACDecoder&) = delete;
         AACDecoder& operator=(const AACDecoder&) = delete;
-        void decode_frame(uint8_t *data, size_t len);
 
-        struct peak_t { int16_t peak_left = 0; int16_t peak_right = 0; };
+        enum class DecodeStatus {
+            Ok,
+            /* The AU starts in the superframe header are inconsistent */
+            InvalidHeader,
+            /* The decoder could not be configured for the audio mode */
+            ConfigFailed,
+            /* An AU was marked invalid by the caller */
+            InvalidAU,
+            /* FDK did not accept an AU */
+            FillFailed,
+            /* FDK could not decode an AU */
+            DecodeFailed,
+        };
+
+        /* Number of errors of each type since the decoder was created */
+        struct errors_t {
+            uint64_t invalid_header = 0;
+            uint64_t config_failed = 0;
+            uint64_t fill_failed = 0;
+            uint64_t decode_failed = 0;
+            /* AUs that FDK concealed, because they were invalid or
+             * could not be decoded */
+            uint64_t concealed = 0;
+        };
+
+        struct config_t {
+            /* Number of times the decoder was set up again because the
+             * audio mode of the stream changed */
+            uint64_t num_reconfigurations = 0;
+            /* Time it took to set up the decoder the last time, in ms */
+            double config_time_ms = 0;
+        };
+
+        /*! Decode a superframe. If discontinuity is set, the superframe
+         *  does not follow the previously decoded one. Only the AUs whose
+         *  bit is set in au_valid are decoded, the others are concealed.
+         *  The decoder is set up again when the audio mode changes.
+         *  frame_seq and ts identify the superframe in the PCM tap.
+         *
+         * \return the first error that occurred in the superframe
+         */
+        DecodeStatus decode_frame(uint8_t *data, size_t len, bool discontinuity = false,
+                uint32_t au_valid = ~0u, uint64_t frame_seq = 0,
+                const std::chrono::system_clock::time_point& ts = {});
+
+        /*! Also write the decoded audio to the given PCM tap */
+        void set_pcm_tap(std::shared_ptr<PCMTap> pcm_tap) { m_pcm_tap = pcm_tap; }
+
+        const errors_t& get_errors() const { return m_errors; }
+
+        const config_t& get_config() const { return m_config; }
+
+        /*! \return the FDK error code of the last failure */
+        AAC_DECODER_ERROR get_last_fdk_error() const { return m_last_fdk_error; }
+
+        /* Absolute peak and RMS level, linear PCM */
+        struct peak_t {
+            int16_t peak_left = 0;
+            int16_t peak_right = 0;
+            int16_t rms_left = 0;
+            int16_t rms_right = 0;
+        };
+
+        /*! Return the levels of the audio decoded since the last call */
         peak_t get_peaks();
 
+        /*! Return the EBU R128 loudness of the decoded audio */
+        LoudnessMeter::loudness_t get_loudness() const { return m_loudness.get_loudness(); }
+
     private:
-        void decode_au(uint8_t *data, size_t len);
+        DecodeStatus configure(uint8_t audio_format);
+        DecodeStatus decode_au(uint8_t *data, size_t len, unsigned int flags);
+        bool conceal_au(unsigned int flags);
+        void measure(const int16_t *samples, size_t num_samples);
+
+        errors_t m_errors;
+        AAC_DECODER_ERROR m_last_fdk_error = AAC_DEC_OK;
+        config_t m_config;
         bool m_decoder_set_up = false;
+        /* Byte 2 of the superframe header the decoder was set up for */
+        uint8_t m_audio_format = 0;
         int m_channels = 0;
+        int m_sample_rate = 0;
+
+        int16_t m_peak[2] = {0, 0};
+        uint64_t m_sum_sq[2] = {0, 0};
+        /* Number of samples per channel in m_sum_sq */
+        uint64_t m_num_samples = 0;
 
-        peak_t m_peak = {};
+        LoudnessMeter m_loudness;
+
+        std::shared_ptr<PCMTap> m_pcm_tap;
 
         HANDLE_AACDECODER m_handle;
         std::vector<uint8_t> m_output_frame;
 };
 
+/*! Runs an AACDecoder in its own thread, so that the outputs need not
+ *  wait for the decoding. The levels of a superframe are therefore only
+ *  available after it has been sent, usually with the following one.
+ */
+class AACDecoderThread {
+    public:
+        AACDecoderThread();
+        ~AACDecoderThread();
+        AACDecoderThread(const AACDecoderThread&) = delete;
+        AACDecoderThread& operator=(const AACDecoderThread&) = delete;
+
+        /*! Only decode one out of interval superframes, the levels are
+         *  then held between two decoded superframes. An interval of 0
+         *  disables decoding. The default is 1, every superframe is decoded.
+         */
+        void set_interval(unsigned int interval);
+
+        /*! \return false if decoding is disabled and the levels are meaningless */
+        bool enabled() const { return m_interval > 0; }
+
+        /*! Queue a superframe without its Reed-Solomon data for decoding,
+         *  of which only the AUs set in au_valid are decoded.
+         *  If the decoder falls behind, the oldest queued superframe is dropped.
+         */
+        void push_frame(const uint8_t *data, size_t len, uint32_t au_valid = ~0u,
+                const std::chrono::system_clock::time_point& ts = {});
+
+        /*! Write the decoded audio of the superframe received at ts to the
+         *  given PCM tap. Must be called before the first push_frame().
+         */
+        void set_pcm_tap(std::shared_ptr<PCMTap> pcm_tap) { m_decoder.set_pcm_tap(pcm_tap); }
+
+        struct levels_t {
+            AACDecoder::peak_t peaks;
+            /* Number of superframes pushed after the one the peaks are from */
+            uint64_t age = 0;
+            /* Number of superframes dropped because the decoder fell behind */
+            uint64_t num_dropped = 0;
+            /* CPU time used by the decoder thread, in seconds */
+            double cpu_time = 0;
+            LoudnessMeter::loudness_t loudness;
+            AACDecoder::errors_t errors;
+            AACDecoder::config_t config;
+        };
+
+        /*! Return the peaks of the superframes decoded since the last call.
+         *  If none was decoded in the meantime, the previous peaks are
+         *  returned again, with a larger age.
+         */
+        levels_t get_levels();
+
+    private:
+        void process();
+
+        struct frame_t {
+            std::vector<uint8_t> data;
+            uint64_t seq = 0;
+            uint32_t au_valid = 0;
+            std::chrono::system_clock::time_point ts;
+        };
+
+        AACDecoder m_decoder;
+        ThreadsafeQueue<frame_t> m_queue;
+
+        /* Buffers of decoded superframes, handed back to push_frame() */
+        ThreadsafeQueue<std::vector<uint8_t> > m_free_buffers;
+
+        unsigned int m_interval = 1;
+        uint64_t m_num_pushed = 0;
+
+        std::mutex m_mutex;
+        levels_t m_levels;
+        uint64_t m_levels_seq = 0;
+        bool m_levels_read = true;
+
+        std::thread m_thread;
+};
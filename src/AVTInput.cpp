@@ -34,10 +34,14 @@
 
 #define MAX_AVT_FRAME_SIZE  (1500)  /* Max AVT MTU = 1472 */
 
-#define MAX_QUEUE_SIZE (5000)
-
 #define MAX_PAD_FRAME_QUEUE_SIZE  (6)
 
+#define MAX_PAD_MESSAGE_SIZE  (2048)
+
+/* Number of packets received with one system call. After a network
+ * interruption, many packets can be waiting in the socket buffer. */
+#define RECEIVE_BATCH_SIZE (32)
+
 // ETSI EN 300 797 V1.2.1 ch 8.2.1.2
 uint8_t STI_FSync0[3] = { 0x1F, 0x90, 0xCA };
 uint8_t STI_FSync1[3] = { 0xE0, 0x6F, 0x35 };
@@ -47,25 +51,47 @@ static uint32_t unpack2(const uint8_t* buf)
     return (buf[0] << 8) | buf[1];
 }
 
-AVTInput::AVTInput(const std::string& input_uri,
+AVTInput::AVTInput(const std::vector<std::string>& input_uris,
         const std::string& output_uri,
         uint32_t pad_port,
-        size_t jitterBufferSize) :
-    _input_uri(input_uri),
+        size_t jitterBufferSize,
+        int32_t gapWaitMs,
+        size_t jitterBufferMinSize) :
     _output_uri(output_uri),
     _pad_port(pad_port),
     _jitterBufferSize(jitterBufferSize),
+    _gapWaitMs(gapWaitMs),
+    _jitterBufferMinSize(jitterBufferMinSize),
 
+    _input_packets(RECEIVE_BATCH_SIZE, Socket::UDPPacket(MAX_AVT_FRAME_SIZE)),
     _output_packet(2048),
     _pad_packet(2048),
-    _ordered(MAX_QUEUE_SIZE, _jitterBufferSize),
+    _pad_message(MAX_PAD_MESSAGE_SIZE),
     _lastInfoFrameType(_typeCantExtract)
-{ }
+{
+    addStream(0);
+    _resetStream(*_streams[0], _dab24msFrameSize);
+
+    for (const auto& uri : input_uris) {
+        _input_paths.emplace_back();
+        _input_paths.back().uri = uri;
+    }
+}
 
 int AVTInput::prepare(void)
 {
-    INFO("Open input socket\n");
-    int ret = _openSocketSrv(&_input_socket, _input_uri.c_str());
+    int ret = 0;
+    for (auto& path : _input_paths) {
+        INFO("Open input socket %s\n", path.uri.c_str());
+        ret = _openSocketSrv(&path.socket, path.uri.c_str());
+        if (ret != 0) {
+            break;
+        }
+
+        if (!path.socket.enableTimestamps()) {
+            INFO("Kernel receive timestamps not available\n");
+        }
+    }
 
     if (ret == 0 && !_output_uri.empty()) {
         INFO("Open output socket\n");
@@ -110,16 +136,45 @@ int AVTInput::setDabPlusParameters(int bitrate, int channels, int sample_rate, b
             ? (sbr ? AVT_Mono_SBR : AVT_Mono)
             : ( ps ? AVT_Stereo_SBR_PS : sbr ? AVT_Stereo_SBR : AVT_Stereo );
 
-    _ordered = OrderedQueue(MAX_QUEUE_SIZE, _jitterBufferSize);
-
-    _currentFrame.clear();
-    _currentFrame.resize(_subChannelIndex*8*5*3);
+    _resetStream(*_streams[0], _dab24msFrameSize);
 
     _sendCtrlMessage();
 
     return ret;
 }
 
+void AVTInput::addStream(size_t stream)
+{
+    if (stream >= _streams.size()) {
+        _streams.resize(stream + 1);
+    }
+
+    if (not _streams[stream]) {
+        // The frame size is set once we receive the stream
+        _streams[stream].reset(new _Stream(_makeQueue(0)));
+    }
+}
+
+OrderedQueue AVTInput::_makeQueue(size_t frameSize) const
+{
+    OrderedQueue queue(MAX_QUEUE_SIZE, _jitterBufferSize, frameSize);
+    queue.setGapWait(std::chrono::milliseconds(_gapWaitMs), std::chrono::milliseconds(24));
+    queue.setAdaptiveCapacity(_jitterBufferMinSize, std::chrono::milliseconds(24));
+    return queue;
+}
+
+void AVTInput::_resetStream(_Stream& stream, size_t frameSize)
+{
+    stream.frameSize = frameSize;
+    stream.ordered = _makeQueue(frameSize);
+    stream.frameAligned = false;
+    stream.currentFrame.clear();
+    stream.currentFrame.resize(frameSize * 5);
+    stream.nbFrames = 0;
+    stream.expectedFrameIndex = 0;
+    stream.currentFrameSize = 0;
+}
+
 bool AVTInput::_parseURI(const char* uri, std::string& address, long& port)
 {
     // Skip the udp:// part if it is present
@@ -200,12 +255,17 @@ bool AVTInput::_isSTI(const uint8_t* buf)
             (memcmp(buf+1, STI_FSync1, sizeof(STI_FSync1)) == 0);
 }
 
-const uint8_t* AVTInput::_findDABFrameFromUDP(const uint8_t* buf, size_t size,
-                                    int32_t& frameNumber, size_t& dataSize)
+bool AVTInput::_findDABFramesFromUDP(_InputPath& path, const uint8_t* buf, size_t size,
+                                    int32_t& frameNumber)
 {
-    const uint8_t* data = NULL;
     uint32_t index = 0;
 
+    // Smallest packet with one stream, without RTP header
+    if (size < 24) {
+        ERROR("Nothing detected\n");
+        return false;
+    }
+
     bool error = !_isSTI(buf+index);
     bool rtp = false;
 
@@ -217,16 +277,16 @@ const uint8_t* AVTInput::_findDABFrameFromUDP(const uint8_t* buf, size_t size,
             uint32_t payloadType = (buf[index+1] & 0x7F);
             if (version == 2 && payloadType == 34) {
                 const uint16_t seqnr = (buf[index+2] << 8) | buf[index+3];
-                if ((_previousRtpIndex != -1) and
-                        (((_previousRtpIndex + 1) % 5000) != seqnr)) {
+                if ((path.previousRtpIndex != -1) and
+                        (((path.previousRtpIndex + 1) % 5000) != seqnr)) {
                     /* the sequence number apparently overflows at 5000, even though
                      * RFC 3550 (RTP protocol) suggests that it should overflow at 0xFFFF.
                      * Maybe the AVT uses DLFC as RTP sequence number.
                      */
-                    fprintf(stderr, "RTP sequence number jump from %d to %d\n",
-                            _previousRtpIndex, seqnr);
+                    fprintf(stderr, "RTP sequence number jump from %d to %d on %s\n",
+                            path.previousRtpIndex, seqnr, path.uri.c_str());
                 }
-                _previousRtpIndex = seqnr;
+                path.previousRtpIndex = seqnr;
 
 #if 0
                 // If one wants to decode the RTP timestamp, here is some
@@ -270,23 +330,46 @@ const uint8_t* AVTInput::_findDABFrameFromUDP(const uint8_t* buf, size_t size,
         uint32_t NST   = unpack2(buf+index) & 0x7FF; // 11 bits
         index += 2;
 
-        if (NST >= 1) {
-            // Take the first stream even if NST > 1
-            uint32_t STL = unpack2(buf+index) & 0x1FFF; // 13 bits
-            uint32_t CRCSTF = buf[index+3] & 0x80 >> 7; // 7th bit
-            index += NST*4+4;
+        // The stream data follows the characterisation of all streams,
+        // one after the other
+        size_t dataIndex = index + NST*4+4;
+
+        if (NST >= 1 and dataIndex <= size) {
+            _streamData.clear();
+            for (uint32_t i = 0; i < NST; i++) {
+                const uint8_t* stc = buf + index + i*4;
+                uint32_t STL = unpack2(stc) & 0x1FFF; // 13 bits
+                uint32_t CRCSTF = (stc[3] & 0x80) >> 7; // 7th bit
+
+                if (dataIndex + STL > size) {
+                    ERROR("Stream %u truncated\n", i);
+                    break;
+                }
+
+                if (STL <= 2*CRCSTF) {
+                    // No data in this stream, it gets skipped
+                    ERROR("Stream %u has invalid length %u\n", i, STL);
+                    _streamData.push_back({buf + dataIndex, 0});
+                    dataIndex += STL;
+                    continue;
+                }
+
+                _streamData.push_back({buf + dataIndex, STL - 2*CRCSTF});
+                dataIndex += STL;
+            }
 
-            data = buf+index;
-            dataSize = STL - 2*CRCSTF;
             frameNumber = DFCTH*250 + DFCTL;
 
-            _info(rtp?_typeSTIRTP:_typeSTI, dataSize);
+            error = _streamData.empty();
+            if (!error) {
+                _info(rtp?_typeSTIRTP:_typeSTI, _streamData[0].size);
+            }
         } else error = true;
     }
 
     if( error ) ERROR("Nothing detected\n");
 
-    return data;
+    return !error;
 }
 
 
@@ -338,16 +421,18 @@ void AVTInput::_sendPADFrame()
         std::vector<uint8_t> frame(move(_padFrameQueue.front()));
         _padFrameQueue.pop();
 
-        std::vector<uint8_t> buf({ 0xFD, 0x18,
-                static_cast<uint8_t>(frame.size()+2),
-                0xAD,
-                static_cast<uint8_t>(frame.size())});
-
         // Always keep the same packet, as it contains the destination address.
         // This function only gets called from _interpretMessage(), which
         // only gets called after a successful packet reception.
-        _pad_packet.buffer = move(buf);
-        copy(frame.begin(), frame.end(), back_inserter(_pad_packet.buffer));
+        // Clearing the buffer keeps its capacity, the message is built in place.
+        auto& buf = _pad_packet.buffer;
+        buf.clear();
+        buf.push_back(0xFD);
+        buf.push_back(0x18);
+        buf.push_back(static_cast<uint8_t>(frame.size()+2));
+        buf.push_back(0xAD);
+        buf.push_back(static_cast<uint8_t>(frame.size()));
+        buf.insert(buf.end(), frame.begin(), frame.end());
         _input_pad_socket.send(_pad_packet);
     }
 }
@@ -373,12 +458,18 @@ void AVTInput::_interpretMessage(const uint8_t *data, size_t size)
 
 bool AVTInput::_checkMessage()
 {
-    _pad_packet = _input_pad_socket.receive(2048);
-    if (_pad_packet.buffer.empty()) {
+    if (_pad_port == 0) {
         return false;
     }
 
-    _interpretMessage(_pad_packet.buffer.data(), _pad_packet.buffer.size());
+    // The sender address is kept in _pad_packet, to which the reply is sent
+    const size_t size = _input_pad_socket.receive(
+            _pad_message.data(), _pad_message.size(), _pad_packet.address);
+    if (size == 0) {
+        return false;
+    }
+
+    _interpretMessage(_pad_message.data(), size);
 
     return true;
 }
@@ -386,120 +477,187 @@ bool AVTInput::_checkMessage()
 void AVTInput::_purgeMessages()
 {
     int nb = 0;
-    do {
-        _pad_packet = _input_pad_socket.receive(2048);
+    Socket::InetAddress source;
+    while (_input_pad_socket.receive(_pad_message.data(), _pad_message.size(), source) > 0) {
         nb++;
-    } while (not _pad_packet.buffer.empty());
+    }
 
-    if (nb>0) DEBUG("%d messages purged\n", nb);
+    if (nb > 0) {
+        DEBUG("%d messages purged\n", nb);
+    }
 }
 
 
-bool AVTInput::_readFrame()
+bool AVTInput::_readFrames()
+{
+    bool received = false;
+
+    for (auto& path : _input_paths) {
+        const size_t numPackets = path.socket.receiveBatch(_input_packets, MAX_AVT_FRAME_SIZE);
+
+        for (size_t i = 0; i < numPackets; i++) {
+            const auto& packet = _input_packets[i];
+            _processFrame(path, packet.buffer.data(), packet.buffer.size(), packet.timestamp);
+        }
+
+        received |= numPackets > 0;
+    }
+
+    return received;
+}
+
+void AVTInput::_countLoss(_InputPath& path, int32_t frameNumber)
+{
+    if (path.previousFrameNumber != -1) {
+        const int32_t diff = (frameNumber - path.previousFrameNumber +
+                MAX_QUEUE_SIZE + MAX_QUEUE_SIZE/2) % MAX_QUEUE_SIZE - MAX_QUEUE_SIZE/2;
+
+        if (diff <= 0) {
+            // Reordered frame, it was counted as lost when we saw the next one
+            if (path.stats.lost > 0) {
+                path.stats.lost--;
+            }
+            return;
+        }
+
+        path.stats.lost += diff - 1;
+    }
+
+    path.previousFrameNumber = frameNumber;
+}
+
+void AVTInput::_processFrame(_InputPath& path, const uint8_t *readBuf, size_t readBytes, const timestamp_t& ts)
 {
     int32_t frameNumber;
-    const uint8_t* dataPtr = NULL;
-    size_t dataSize = 0;
 
-    auto packet = _input_socket.receive(MAX_AVT_FRAME_SIZE);
-    const timestamp_t ts = std::chrono::system_clock::now();
-    const size_t readBytes = packet.buffer.size();
+    // Extract frame data and frame number from buf
+    if (not _findDABFramesFromUDP(path, readBuf, readBytes, frameNumber)) {
+        _info(_typeCantExtract, 0);
+        return;
+    }
 
-    if (readBytes > 0) {
-        const uint8_t *readBuf = packet.buffer.data();
+    path.stats.received++;
+    _countLoss(path, frameNumber);
 
-        if (readBytes > _dab24msFrameSize) {
-            // Extract frame data and frame number from buf
-            dataPtr = _findDABFrameFromUDP(readBuf, readBytes, frameNumber, dataSize);
+    const size_t numStreams = std::min(_streamData.size(), _streams.size());
+    for (size_t i = 0; i < numStreams; i++) {
+        const auto& streamData = _streamData[i];
+        if (not _streams[i] or streamData.size == 0) {
+            continue;
         }
 
-        if (dataPtr) {
-            if (dataSize == _dab24msFrameSize) {
-                _ordered.push(frameNumber, dataPtr, dataSize, ts);
+        auto& stream = *_streams[i];
+
+        if (streamData.size != stream.frameSize) {
+            if (i == 0) {
+                ERROR("Wrong frame size from encoder %zu != %zu\n", streamData.size, stream.frameSize);
+                continue;
             }
-            else ERROR("Wrong frame size from encoder %zu != %zu\n", dataSize, _dab24msFrameSize);
+
+            INFO("Stream %zu has frames of size %zu\n", i, streamData.size);
+            _resetStream(stream, streamData.size);
         }
-        else {
-            _info(_typeCantExtract, 0);
+
+        const auto result = stream.ordered.push(frameNumber, streamData.data, streamData.size, ts);
+
+        // All streams come in the same packets, count them once
+        if (i == 0) {
+            switch (result) {
+                case OrderedQueue::PushResult::Duplicate:
+                    path.stats.duplicates++;
+                    break;
+                case OrderedQueue::PushResult::Late:
+                    path.stats.late++;
+                    break;
+                default:
+                    break;
+            }
         }
     }
-
-    return readBytes > 0;
 }
 
-size_t AVTInput::getNextFrame(std::vector<uint8_t> &buf, std::chrono::system_clock::time_point& ts)
+size_t AVTInput::getNextFrame(size_t streamIndex, std::vector<uint8_t> &buf, std::chrono::system_clock::time_point& ts)
 {
     //printf("A: _padFrameQueue size=%zu\n", _padFrameQueue.size());
 
     // Read all messages from encoder (in priority)
     // Read all available frames from input socket
-    while (_checkMessage() || _readFrame() );
+    while (_checkMessage() || _readFrames());
 
     //printf("B: _padFrameQueue size=%zu\n", _padFrameQueue.size());
 
+    if (streamIndex >= _streams.size() or not _streams[streamIndex]) {
+        return 0;
+    }
+    auto& stream = *_streams[streamIndex];
+
     // Assemble next frame, ensuring it is composed of five parts with
     // indexes that are contiguous, and where index%5==0 for the first part.
     int32_t returnedIndex = -1;
 
-    while (_nbFrames < 5) {
-        const auto queue_data = _ordered.pop(&returnedIndex);
-        const auto& part = queue_data.buf;
-        if (part.empty()) {
+    while (stream.nbFrames < 5) {
+        const auto queue_data = stream.ordered.pop(&returnedIndex);
+        if (queue_data == nullptr) {
             break;
         }
+        const auto& part = queue_data->buf;
 
         while (_checkMessage()) {};
 
-        if (not _frameAligned) {
+        if (not stream.frameAligned) {
             if (returnedIndex % 5 == 0) {
-                _frameAligned = true;
-                _frameZeroTimestamp = queue_data.capture_timestamp;
+                stream.frameAligned = true;
+                stream.frameZeroTimestamp = queue_data->capture_timestamp;
 
-                memcpy(_currentFrame.data() + _currentFrameSize, part.data(), part.size());
-                _currentFrameSize += part.size();
-                _nbFrames++;
-                _expectedFrameIndex = (returnedIndex + 1) % MAX_QUEUE_SIZE;
+                memcpy(stream.currentFrame.data() + stream.currentFrameSize, part.data(), part.size());
+                stream.currentFrameSize += part.size();
+                stream.nbFrames++;
+                stream.expectedFrameIndex = (returnedIndex + 1) % MAX_QUEUE_SIZE;
             }
         }
         else {
-            if (returnedIndex % 5 == _nbFrames) {
-                if (_expectedFrameIndex != returnedIndex) {
+            if (returnedIndex % 5 == stream.nbFrames) {
+                if (stream.expectedFrameIndex != returnedIndex) {
                     /* This does not constitute a reason to discard data, because
                      * we still send properly aligned superframes.
                      */
                     fprintf(stderr, "Superframe sequence error, expected %d received %d\n",
-                            _expectedFrameIndex, returnedIndex);
+                            stream.expectedFrameIndex, returnedIndex);
                 }
 
-                memcpy(_currentFrame.data() + _currentFrameSize, part.data(), part.size());
-                _currentFrameSize += part.size();
-                _nbFrames++;
+                memcpy(stream.currentFrame.data() + stream.currentFrameSize, part.data(), part.size());
+                stream.currentFrameSize += part.size();
+                stream.nbFrames++;
 
                 // UDP packets arrive with jitter, we intentionally only consider
                 // their timestamp after a discontinuity.
-                _frameZeroTimestamp += std::chrono::milliseconds(24);
+                stream.frameZeroTimestamp += std::chrono::milliseconds(24);
 
-                _expectedFrameIndex = (returnedIndex + 1) % MAX_QUEUE_SIZE;
+                stream.expectedFrameIndex = (returnedIndex + 1) % MAX_QUEUE_SIZE;
 
             }
             else {
-                fprintf(stderr, "Frame alignment reset, expected %d received %d\n", _expectedFrameIndex, returnedIndex);
+                fprintf(stderr, "Frame alignment reset, expected %d received %d\n", stream.expectedFrameIndex, returnedIndex);
 
-                _nbFrames = 0;
-                _currentFrameSize = 0;
-                _frameAligned = false;
-                _expectedFrameIndex = 0;
+                stream.nbFrames = 0;
+                stream.currentFrameSize = 0;
+                stream.frameAligned = false;
+                stream.expectedFrameIndex = 0;
             }
         }
     }
 
     size_t nbBytes = 0;
-    if (_nbFrames == 5 && _currentFrameSize <= buf.size()) {
-        memcpy(&buf[0], _currentFrame.data(), _currentFrameSize);
-        nbBytes = _currentFrameSize;
-        _currentFrameSize = 0;
-        _nbFrames = 0;
-        ts = _frameZeroTimestamp;
+    if (stream.nbFrames == 5) {
+        // Hand the assembled superframe over to the caller, and assemble
+        // the next one into the buffer we get back.
+        buf.swap(stream.currentFrame);
+        stream.currentFrame.resize(stream.frameSize * 5);
+
+        nbBytes = stream.currentFrameSize;
+        stream.currentFrameSize = 0;
+        stream.nbFrames = 0;
+        ts = stream.frameZeroTimestamp;
     }
 
     //printf("C: _padFrameQueue size=%zu\n", _padFrameQueue.size());
@@ -507,6 +665,21 @@ size_t AVTInput::getNextFrame(std::vector<uint8_t> &buf, std::chrono::system_clo
     return nbBytes;
 }
 
+bool AVTInput::gapDeadline(std::chrono::system_clock::time_point& deadline) const
+{
+    bool found = false;
+    for (const auto& stream : _streams) {
+        timestamp_t streamDeadline;
+        if (stream and stream->ordered.gapDeadline(streamDeadline)) {
+            if (not found or streamDeadline < deadline) {
+                deadline = streamDeadline;
+            }
+            found = true;
+        }
+    }
+    return found;
+}
+
 void AVTInput::pushPADFrame(const uint8_t* buf, size_t size)
 {
     if (_pad_port == 0) {
@@ -525,6 +698,28 @@ bool AVTInput::padQueueFull()
     return _padFrameQueue.size() >= MAX_PAD_FRAME_QUEUE_SIZE;
 }
 
+std::vector<int> AVTInput::getNativeSockets() const
+{
+    std::vector<int> fds;
+    for (const auto& path : _input_paths) {
+        fds.push_back(path.socket.getNativeSocket());
+    }
+
+    if (_pad_port > 0) {
+        fds.push_back(_input_pad_socket.getNativeSocket());
+    }
+
+    return fds;
+}
+
+OrderedQueueStats AVTInput::getJitterBufferStats(size_t stream) const
+{
+    if (stream >= _streams.size() or not _streams[stream]) {
+        return OrderedQueueStats();
+    }
+    return _streams[stream]->ordered.getStats();
+}
+
 void AVTInput::_info(_frameType type, size_t size)
 {
     if (_lastInfoFrameType != type || _lastInfoSize != size) {
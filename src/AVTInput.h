@@ -38,9 +38,16 @@
 #include <queue>
 #include <vector>
 #include <chrono>
+#include <memory>
 
 #define DEF_BR  64
 
+/* The frame numbers of the STI frames wrap around at this value */
+#define MAX_QUEUE_SIZE (5000)
+
+/* The jitter buffer must hold less than half of all frame numbers */
+#define MAX_JITTER_BUFFER_SIZE ((MAX_QUEUE_SIZE - 1) / 2)
+
 // The enum values folown the AVT messages definitions.
 enum {
     AVT_Mono            = 0,
@@ -62,11 +69,27 @@ enum {
 };
 
 
+/*! Counters for one of the paths the encoder sends the stream over */
+struct AVTInputPathStats {
+    /* Frames received on this path */
+    uint64_t received = 0;
+    /* Frames missing from the sequence received on this path */
+    uint64_t lost = 0;
+    /* Frames that arrived after they had been skipped */
+    uint64_t late = 0;
+    /* Frames that arrived on another path first */
+    uint64_t duplicates = 0;
+};
+
 class AVTInput
 {
     public:
-        AVTInput(const std::string& input_uri, const std::string& output_uri, uint32_t pad_port,
-                size_t jitterBufferSize = 40);
+        /*! The encoder can send the same stream to several input URIs, over
+         *! different networks. The first copy of every frame is used.
+         */
+        AVTInput(const std::vector<std::string>& input_uris, const std::string& output_uri, uint32_t pad_port,
+                size_t jitterBufferSize = 40, int32_t gapWaitMs = 0,
+                size_t jitterBufferMinSize = 0);
 
         /*! Open the file and prepare the wav decoder.
          *
@@ -80,12 +103,29 @@ class AVTInput
          */
         int setDabPlusParameters(int bitrate, int channels, int sample_rate, bool sbr, bool ps);
 
+        /*! Also extract the stream with the given index from STI frames
+         *! that carry several streams. Stream 0 is always extracted, and is
+         *! the one set up by setDabPlusParameters(). The frame size of the
+         *! other streams is taken from the STI frames.
+         */
+        void addStream(size_t stream);
+
         /*! Read incoming frames from the encoder, reorder and reassemble then into DAB+ superframes
-         *! Give the next reassembled audio frame (120ms for DAB+)
+         *! Give the next reassembled audio frame (120ms for DAB+) of the given stream
+         *! The frame is assembled in place and swapped into buf, whose previous
+         *! storage is reused to assemble the following frame.
          *
          * \return the size of the frame or 0 if none are available yet
          */
-        size_t getNextFrame(std::vector<uint8_t> &buf, std::chrono::system_clock::time_point& ts);
+        size_t getNextFrame(size_t stream, std::vector<uint8_t> &buf, std::chrono::system_clock::time_point& ts);
+        size_t getNextFrame(std::vector<uint8_t> &buf, std::chrono::system_clock::time_point& ts)
+        { return getNextFrame(0, buf, ts); }
+
+        /*! If a frame is missing in the jitter buffer of a stream, set deadline
+         *! to the earliest time when one will be skipped, and return true.
+         *! getNextFrame() must be called at that time.
+         */
+        bool gapDeadline(std::chrono::system_clock::time_point& deadline) const;
 
         /*! Store a new PAD frame.
          *! Frames are sent to the encoder on request
@@ -95,19 +135,46 @@ class AVTInput
         /* \return true if PAD Frame queue is full */
         bool padQueueFull();
 
+        /*! \return the file descriptors of the sockets that receive data from
+         *! the encoder, so that the caller can wait on them with poll()
+         */
+        std::vector<int> getNativeSockets() const;
+
+        /*! \return the fill level, target size and measured jitter of the
+         *! jitter buffer
+         */
+        OrderedQueueStats getJitterBufferStats(size_t stream = 0) const;
+
+        /*! \return the number of input paths, one per input URI */
+        size_t getNumInputPaths() const { return _input_paths.size(); }
+
+        /*! \return the counters of the input path with the given index,
+         *! in the order of the input URIs */
+        const AVTInputPathStats& getInputPathStats(size_t path) const
+        { return _input_paths.at(path).stats; }
+
 
     private:
-        std::string _input_uri;
         std::string _output_uri;
         uint32_t _pad_port;
         size_t _jitterBufferSize;
+        int32_t _gapWaitMs;
+        size_t _jitterBufferMinSize;
 
-        Socket::UDPSocket _input_socket;
+        struct _InputPath {
+            std::string uri;
+            Socket::UDPSocket socket;
+            int32_t previousRtpIndex = -1;
+            int32_t previousFrameNumber = -1;
+            AVTInputPathStats stats;
+        };
+        std::vector<_InputPath> _input_paths;
+        std::vector<Socket::UDPPacket> _input_packets;
         Socket::UDPSocket _output_socket;
         Socket::UDPPacket _output_packet;
         Socket::UDPSocket _input_pad_socket;
         Socket::UDPPacket _pad_packet;
-        OrderedQueue _ordered;
+        std::vector<uint8_t> _pad_message;
         std::queue<std::vector<uint8_t> > _padFrameQueue;
 
         int32_t _subChannelIndex = DEF_BR/8;
@@ -116,13 +183,32 @@ class AVTInput
         int32_t _monoMode = AVT_MonoMode_LR2;
         int32_t _dac = AVT_DAC_48;
         size_t _dab24msFrameSize = DEF_BR*3;
-        bool _frameAligned = false;
-        std::vector<uint8_t> _currentFrame;
-        int32_t _nbFrames = 0;
-        int32_t _expectedFrameIndex = 0;
-        int32_t _previousRtpIndex = -1;
-        std::chrono::system_clock::time_point _frameZeroTimestamp;
-        size_t _currentFrameSize = 0;
+
+        /* Reordering and superframe reassembly of one stream */
+        struct _Stream {
+            _Stream(OrderedQueue&& queue) : ordered(std::move(queue)) {}
+
+            size_t frameSize = 0;
+            OrderedQueue ordered;
+            bool frameAligned = false;
+            std::vector<uint8_t> currentFrame;
+            int32_t nbFrames = 0;
+            int32_t expectedFrameIndex = 0;
+            std::chrono::system_clock::time_point frameZeroTimestamp;
+            size_t currentFrameSize = 0;
+        };
+        /* Indexed by stream number, empty for streams we don't extract */
+        std::vector<std::unique_ptr<_Stream> > _streams;
+
+        /* Position of the streams in the STI frame being processed */
+        struct _StreamData {
+            const uint8_t* data;
+            size_t size;
+        };
+        std::vector<_StreamData> _streamData;
+
+        OrderedQueue _makeQueue(size_t frameSize) const;
+        void _resetStream(_Stream& stream, size_t frameSize);
 
         bool _parseURI(const char* uri, std::string& address, long& port);
         int _openSocketSrv(Socket::UDPSocket* socket, const char* uri);
@@ -137,19 +223,26 @@ class AVTInput
         /*! Test Bytes 1,2,3 for STI detection */
         bool _isSTI(const uint8_t* buf);
 
-        /*! Find and extract the DAB frame from UDP/RTP/STI received frame
+        /*! Find the DAB frames of all streams in a UDP/RTP/STI received frame,
+         *  and store their position in _streamData
          * \param   frameNumber will contain the frameNumber
-         * \param   dataSize will contain the actual DAB frame size
-         * \return  Pointer to first byte of the DAB frame, or NULL if not found
+         * \return  false if no DAB frame was found
          */
-        const uint8_t* _findDABFrameFromUDP(const uint8_t* buf, size_t size,
-                                    int32_t& frameNumber, size_t& dataSize);
+        bool _findDABFramesFromUDP(_InputPath& path, const uint8_t* buf, size_t size,
+                                    int32_t& frameNumber);
 
-        /*! Read and store one frame from encoder
+        /*! Read and store all frames the encoder sent, up to the
+         *  size of the receive batch
          *
          * \return true if a data has been received
          */
-        bool _readFrame();
+        bool _readFrames();
+
+        /*! Extract and store the frame contained in one packet from the encoder */
+        void _processFrame(_InputPath& path, const uint8_t *readBuf, size_t readBytes, const timestamp_t& ts);
+
+        /*! Update the loss counter of path with a newly received frame number */
+        void _countLoss(_InputPath& path, int32_t frameNumber);
 
         /*! Output info about received frames*/
         enum _frameType {
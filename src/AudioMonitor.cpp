@@ -0,0 +1,129 @@
+/* ------------------------------------------------------------------
+ * Copyright (C) 2019 Matthias P. Braendli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ * -------------------------------------------------------------------
+ */
+
+#include "AudioMonitor.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// Duration of a superframe
+static const double SUPERFRAME_DURATION_S = 0.12;
+
+// 64-bit FNV-1a
+static uint64_t hash_superframe(const uint8_t *data, size_t len)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= data[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+void AudioMonitor::set_config(const config_t& config, size_t stream)
+{
+    m_config = config;
+    m_stream = stream;
+    m_silence_peak = std::lround(32767.0 * std::pow(10.0, config.silence_level_dbfs / 20.0));
+}
+
+void AudioMonitor::process(const uint8_t *data, size_t len,
+        int16_t peak_left, int16_t peak_right, bool levels_valid)
+{
+    reap_hooks();
+
+    if (m_config.stuck_frames > 0) {
+        const uint64_t hash = hash_superframe(data, len);
+        if (hash == m_last_hash) {
+            m_state.stuck_frames++;
+        }
+        else {
+            m_state.stuck_frames = 0;
+            m_last_hash = hash;
+        }
+
+        const bool stuck = m_state.stuck_frames >= m_config.stuck_frames;
+        if (stuck != m_state.stuck) {
+            m_state.stuck = stuck;
+            event(stuck ? "stuck_start" : "stuck_end");
+        }
+    }
+
+    if (m_config.silence_duration_s > 0 and levels_valid) {
+        if (std::max(peak_left, peak_right) < m_silence_peak) {
+            m_silent_frames++;
+        }
+        else {
+            m_silent_frames = 0;
+        }
+
+        m_state.silence_s = m_silent_frames * SUPERFRAME_DURATION_S;
+
+        const bool silence = m_state.silence_s >= m_config.silence_duration_s;
+        if (silence != m_state.silence) {
+            m_state.silence = silence;
+            event(silence ? "silence_start" : "silence_end");
+        }
+    }
+}
+
+void AudioMonitor::event(const char *name)
+{
+    m_state.num_events++;
+    fprintf(stderr, "Audio monitor: %s on stream %zu\n", name, m_stream);
+
+    if (m_config.hook.empty()) {
+        return;
+    }
+
+    // Prepare everything before fork(), the child must only call exec
+    const std::string command = m_config.hook + " \"$1\" \"$2\"";
+    const std::string stream = std::to_string(m_stream);
+
+    const pid_t pid = fork();
+    if (pid == 0) {
+        execl("/bin/sh", "sh", "-c", command.c_str(), "sh", name, stream.c_str(), nullptr);
+        _exit(127);
+    }
+    else if (pid == -1) {
+        fprintf(stderr, "Audio monitor: cannot run hook: %s\n", strerror(errno));
+    }
+    else {
+        m_hook_pids.push_back(pid);
+    }
+}
+
+void AudioMonitor::reap_hooks()
+{
+    // Hooks run in the background, collect those that have terminated
+    m_hook_pids.erase(std::remove_if(m_hook_pids.begin(), m_hook_pids.end(),
+                [](pid_t pid) {
+                    int wstatus = 0;
+                    const pid_t r = waitpid(pid, &wstatus, WNOHANG);
+                    if (r == pid and WIFEXITED(wstatus) and WEXITSTATUS(wstatus) != 0) {
+                        fprintf(stderr, "Audio monitor: hook returned %d\n",
+                                WEXITSTATUS(wstatus));
+                    }
+                    return r != 0;
+                }), m_hook_pids.end());
+}
+
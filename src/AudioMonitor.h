@@ -0,0 +1,98 @@
+/* ------------------------------------------------------------------
+ * Copyright (C) 2019 Matthias P. Braendli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ * -------------------------------------------------------------------
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
+
+/*! \file AudioMonitor.h
+ *
+ * Detects silence and a stuck encoder in a stream, superframe by
+ * superframe.
+ *
+ * Silence is a peak level below a threshold for a given time. It is taken
+ * from the levels the decoder measures, and is therefore only detected if
+ * decoding is enabled.
+ *
+ * A stuck encoder sends the same superframe over and over. Every
+ * superframe is hashed and compared with the previous one.
+ *
+ * The start and end of both alarms are logged, counted, and can run a
+ * hook command.
+ */
+class AudioMonitor {
+    public:
+        struct config_t {
+            /* Peak level in dBFS below which the audio is silent */
+            double silence_level_dbfs = -60.0;
+            /* Time the audio must be silent before the alarm is raised, 0
+             * disables silence detection */
+            double silence_duration_s = 10.0;
+            /* Number of identical superframes after which the encoder is
+             * stuck, 0 disables the detection */
+            size_t stuck_frames = 25;
+            /* Command to run on every event, with the event name and the
+             * stream index as arguments */
+            std::string hook;
+        };
+
+        struct state_t {
+            bool silence = false;
+            /* Duration of the current silence, in seconds */
+            double silence_s = 0;
+            bool stuck = false;
+            /* Number of superframes identical to the last different one */
+            uint64_t stuck_frames = 0;
+            /* Number of alarm starts and ends so far */
+            uint64_t num_events = 0;
+        };
+
+        AudioMonitor() = default;
+        AudioMonitor(const AudioMonitor& other) = delete;
+        AudioMonitor& operator=(const AudioMonitor& other) = delete;
+
+        void set_config(const config_t& config, size_t stream);
+
+        /*! Check the superframe data, including its Reed-Solomon parity,
+         * and the peaks of the latest decoded superframe, if
+         * levels_valid is set. */
+        void process(const uint8_t *data, size_t len,
+                int16_t peak_left, int16_t peak_right, bool levels_valid);
+
+        const state_t& get_state() const { return m_state; }
+
+    private:
+        void event(const char *name);
+        void reap_hooks();
+
+        config_t m_config;
+        size_t m_stream = 0;
+        int16_t m_silence_peak = 0;
+
+        uint64_t m_silent_frames = 0;
+        uint64_t m_last_hash = 0;
+
+        state_t m_state;
+
+        /* Hook commands that have not terminated yet */
+        std::vector<pid_t> m_hook_pids;
+};
+
@@ -0,0 +1,198 @@
+/* ------------------------------------------------------------------
+ * Copyright (C) 2019 Matthias P. Braendli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ * -------------------------------------------------------------------
+ */
+
+#include "LoudnessMeter.h"
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+using namespace std;
+
+// Blocks of 100ms
+static const size_t MOMENTARY_BLOCKS = 4;
+static const size_t SHORTTERM_BLOCKS = 30;
+
+// Absolute and relative gates, BS.1770-4
+static const double ABSOLUTE_GATE = -70.0;
+static const double RELATIVE_GATE = -10.0;
+
+// Histogram of gating block loudness, from the absolute gate to +10 LUFS
+static const double HIST_STEP = 0.1;
+static const size_t HIST_BINS = 800;
+
+static double energy_to_loudness(double energy)
+{
+    if (energy <= 0) {
+        return -numeric_limits<double>::infinity();
+    }
+    return -0.691 + 10.0 * log10(energy);
+}
+
+LoudnessMeter::LoudnessMeter() :
+    m_blocks(SHORTTERM_BLOCKS, 0),
+    m_hist_count(HIST_BINS, 0),
+    m_hist_energy(HIST_BINS, 0)
+{
+    reset(48000, 2);
+}
+
+void LoudnessMeter::reset(int sample_rate, int channels)
+{
+    // K-weighting filter coefficients for the sample rate, derived from
+    // the analog prototypes of the 48kHz filters given in BS.1770
+    const double fs = sample_rate;
+
+    double f0 = 1681.974450955533;
+    const double G = 3.999843853973347;
+    double Q = 0.7071752369554196;
+    double K = tan(M_PI * f0 / fs);
+    const double Vh = pow(10.0, G / 20.0);
+    const double Vb = pow(Vh, 0.4996667741545416);
+    double a0 = 1.0 + K / Q + K * K;
+    m_prefilter.b0 = (Vh + Vb * K / Q + K * K) / a0;
+    m_prefilter.b1 = 2.0 * (K * K - Vh) / a0;
+    m_prefilter.b2 = (Vh - Vb * K / Q + K * K) / a0;
+    m_prefilter.a1 = 2.0 * (K * K - 1.0) / a0;
+    m_prefilter.a2 = (1.0 - K / Q + K * K) / a0;
+
+    f0 = 38.13547087602444;
+    Q = 0.5003270373238773;
+    K = tan(M_PI * f0 / fs);
+    a0 = 1.0 + K / Q + K * K;
+    m_rlb.b0 = 1.0;
+    m_rlb.b1 = -2.0;
+    m_rlb.b2 = 1.0;
+    m_rlb.a1 = 2.0 * (K * K - 1.0) / a0;
+    m_rlb.a2 = (1.0 - K / Q + K * K) / a0;
+
+    m_channels = channels;
+    m_state.assign(channels, filter_state_t());
+
+    m_block_len = sample_rate / 10;
+    m_block_pos = 0;
+    m_block_energy = 0;
+
+    fill(m_blocks.begin(), m_blocks.end(), 0);
+    m_blocks_next = 0;
+    m_num_blocks = 0;
+
+    fill(m_hist_count.begin(), m_hist_count.end(), 0);
+    fill(m_hist_energy.begin(), m_hist_energy.end(), 0);
+}
+
+void LoudnessMeter::process(const int16_t *samples, size_t num_samples)
+{
+    const size_t channels = m_channels;
+
+    for (size_t i = 0; i + channels <= num_samples; i += channels) {
+        for (size_t ch = 0; ch < channels; ch++) {
+            auto& st = m_state[ch];
+            const double x = samples[i + ch] / 32768.0;
+
+            // Transposed direct form II, pre-filter then RLB high-pass
+            const double y1 = m_prefilter.b0 * x + st.z1[0];
+            st.z1[0] = m_prefilter.b1 * x - m_prefilter.a1 * y1 + st.z2[0];
+            st.z2[0] = m_prefilter.b2 * x - m_prefilter.a2 * y1;
+
+            const double y2 = m_rlb.b0 * y1 + st.z1[1];
+            st.z1[1] = m_rlb.b1 * y1 - m_rlb.a1 * y2 + st.z2[1];
+            st.z2[1] = m_rlb.b2 * y1 - m_rlb.a2 * y2;
+
+            // Left and right have a channel weight of 1.0
+            m_block_energy += y2 * y2;
+        }
+
+        if (++m_block_pos == m_block_len) {
+            end_block();
+        }
+    }
+}
+
+void LoudnessMeter::end_block()
+{
+    m_blocks[m_blocks_next] = m_block_energy / m_block_len;
+    m_blocks_next = (m_blocks_next + 1) % m_blocks.size();
+    m_num_blocks++;
+    m_block_pos = 0;
+    m_block_energy = 0;
+
+    if (m_num_blocks < MOMENTARY_BLOCKS) {
+        return;
+    }
+
+    // Every block completes a 400ms gating block
+    const double energy = energy_over(MOMENTARY_BLOCKS);
+    const double loudness = energy_to_loudness(energy);
+    if (loudness >= ABSOLUTE_GATE) {
+        const size_t bin = min((size_t)((loudness - ABSOLUTE_GATE) / HIST_STEP), HIST_BINS - 1);
+        m_hist_count[bin]++;
+        m_hist_energy[bin] += energy;
+    }
+}
+
+double LoudnessMeter::energy_over(size_t num_blocks) const
+{
+    const size_t n = min(num_blocks, (size_t)m_num_blocks);
+    if (n == 0) {
+        return 0;
+    }
+
+    double sum = 0;
+    for (size_t i = 1; i <= n; i++) {
+        sum += m_blocks[(m_blocks_next + m_blocks.size() - i) % m_blocks.size()];
+    }
+    return sum / n;
+}
+
+LoudnessMeter::loudness_t LoudnessMeter::get_loudness() const
+{
+    const double inf = numeric_limits<double>::infinity();
+
+    loudness_t l;
+    l.momentary = m_num_blocks >= MOMENTARY_BLOCKS ?
+        energy_to_loudness(energy_over(MOMENTARY_BLOCKS)) : -inf;
+    l.shortterm = m_num_blocks >= SHORTTERM_BLOCKS ?
+        energy_to_loudness(energy_over(SHORTTERM_BLOCKS)) : -inf;
+
+    // Relative gate from the blocks above the absolute gate
+    uint64_t count = 0;
+    double energy = 0;
+    for (size_t bin = 0; bin < HIST_BINS; bin++) {
+        count += m_hist_count[bin];
+        energy += m_hist_energy[bin];
+    }
+
+    l.integrated = -inf;
+    if (count > 0) {
+        const double gate = energy_to_loudness(energy / count) + RELATIVE_GATE;
+        const double first_bin = ceil((gate - ABSOLUTE_GATE) / HIST_STEP);
+
+        count = 0;
+        energy = 0;
+        for (size_t bin = first_bin > 0 ? first_bin : 0; bin < HIST_BINS; bin++) {
+            count += m_hist_count[bin];
+            energy += m_hist_energy[bin];
+        }
+
+        if (count > 0) {
+            l.integrated = energy_to_loudness(energy / count);
+        }
+    }
+
+    return l;
+}
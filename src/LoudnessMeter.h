@@ -0,0 +1,84 @@
+/* ------------------------------------------------------------------
+ * Copyright (C) 2019 Matthias P. Braendli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ * -------------------------------------------------------------------
+ */
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <limits>
+
+/*! \file LoudnessMeter.h
+ *
+ * Loudness measurement according to EBU R128 and ITU-R BS.1770.
+ *
+ * The samples are K-weighted and their mean square is accumulated over
+ * blocks of 100ms. The momentary and short-term loudness are taken over
+ * the last 4 and 30 blocks. Every 400ms gating block, overlapping by 75%,
+ * is counted in a histogram of 0.1 LU bins, from which the gated
+ * integrated loudness is derived without keeping the blocks themselves.
+ */
+class LoudnessMeter {
+    public:
+        /*! Loudness values in LUFS, -inf if not available yet */
+        struct loudness_t {
+            double momentary = -std::numeric_limits<double>::infinity();
+            double shortterm = -std::numeric_limits<double>::infinity();
+            double integrated = -std::numeric_limits<double>::infinity();
+        };
+
+        LoudnessMeter();
+
+        /*! Restart the measurement for the given audio parameters */
+        void reset(int sample_rate, int channels);
+
+        /*! Feed interleaved samples, num_samples counts all channels */
+        void process(const int16_t *samples, size_t num_samples);
+
+        loudness_t get_loudness() const;
+
+    private:
+        struct biquad_t {
+            double b0 = 0, b1 = 0, b2 = 0, a1 = 0, a2 = 0;
+        };
+
+        struct filter_state_t {
+            double z1[2] = {0, 0};
+            double z2[2] = {0, 0};
+        };
+
+        int m_channels = 0;
+        biquad_t m_prefilter;
+        biquad_t m_rlb;
+        std::vector<filter_state_t> m_state;
+
+        /* Samples per channel in a 100ms block */
+        size_t m_block_len = 0;
+        size_t m_block_pos = 0;
+        double m_block_energy = 0;
+
+        /* Ring of the mean square of the last 30 blocks */
+        std::vector<double> m_blocks;
+        size_t m_blocks_next = 0;
+        size_t m_num_blocks = 0;
+
+        std::vector<uint64_t> m_hist_count;
+        std::vector<double> m_hist_energy;
+
+        void end_block();
+        double energy_over(size_t num_blocks) const;
+};
@@ -22,98 +22,330 @@
 #include <cstdint>
 #include <cstring>
 #include <cstdio>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 
 using namespace std;
 
+// Number of frames after which the adaptive target may shrink by one frame
+static const size_t ADAPT_INTERVAL = 250;
+
+// The target covers this many times the measured jitter
+static const double JITTER_MARGIN = 4.0;
+
 #define DEBUG(fmt, A...)   fprintf(stderr, "OrderedQueue: " fmt, ##A)
 //#define DEBUG(x...)
 #define ERROR(fmt, A...)   fprintf(stderr, "OrderedQueue: ERROR " fmt, ##A)
 
-OrderedQueue::OrderedQueue(int maxIndex, size_t capacity) :
+OrderedQueue::OrderedQueue(int maxIndex, size_t capacity, size_t frameSize) :
     _maxIndex(maxIndex),
-    _capacity(capacity)
+    _capacity(capacity),
+    _target(capacity),
+    _slots(2 * capacity),
+    _occupied((2 * capacity + 63) / 64, 0),
+    _returned((maxIndex + 63) / 64, 0)
+{
+    if (_capacity == 0 or 2 * _capacity >= (size_t)_maxIndex) {
+        throw invalid_argument("OrderedQueue: capacity must be between 1 and " +
+                to_string((_maxIndex - 1) / 2));
+    }
+
+    for (auto& slot : _slots) {
+        slot.buf.reserve(frameSize);
+    }
+}
+
+void OrderedQueue::setGapWait(chrono::milliseconds gapWait, chrono::milliseconds frameDuration)
+{
+    _gapWait = gapWait;
+    _frameDuration = frameDuration;
+}
+
+void OrderedQueue::setAdaptiveCapacity(size_t minCapacity, chrono::milliseconds frameDuration)
+{
+    if (minCapacity > _capacity) {
+        throw invalid_argument("OrderedQueue: minimum capacity larger than capacity");
+    }
+
+    _minCapacity = minCapacity;
+    _frameDuration = frameDuration;
+    _target = minCapacity > 0 ? minCapacity : _capacity;
+}
+
+bool OrderedQueue::_isOccupied(size_t slot) const
+{
+    return (_occupied[slot / 64] >> (slot % 64)) & 1;
+}
+
+void OrderedQueue::_setOccupied(size_t slot, bool occupied)
 {
+    const uint64_t mask = (uint64_t)1 << (slot % 64);
+    if (occupied) {
+        _occupied[slot / 64] |= mask;
+    }
+    else {
+        _occupied[slot / 64] &= ~mask;
+    }
+}
+
+void OrderedQueue::_setReturned(int32_t index, bool returned)
+{
+    const uint64_t mask = (uint64_t)1 << (index % 64);
+    if (returned) {
+        _returned[index / 64] |= mask;
+    }
+    else {
+        _returned[index / 64] &= ~mask;
+    }
+}
+
+size_t OrderedQueue::_findOccupied(size_t begin, size_t end) const
+{
+    while (begin < end) {
+        const size_t word = begin / 64;
+        const uint64_t bits = _occupied[word] >> (begin % 64);
+        if (bits) {
+            const size_t slot = begin + __builtin_ctzll(bits);
+            return slot < end ? slot : end;
+        }
+        begin = (word + 1) * 64;
+    }
+    return end;
+}
+
+size_t OrderedQueue::_nextOccupied() const
+{
+    // Search until the end of the ring, then wrap around
+    const size_t slot = _findOccupied(_head, _window());
+    if (slot < _window()) {
+        return slot - _head;
+    }
+    return _findOccupied(0, _head) + _window() - _head;
+}
+
+int32_t OrderedQueue::_indexDiff(int32_t index, int32_t reference) const
+{
+    const int32_t half = _maxIndex / 2;
+    return (index - reference + _maxIndex + half) % _maxIndex - half;
+}
+
+void OrderedQueue::_measureArrival(int32_t index, const timestamp_t& ts)
+{
+    const int32_t window = _window();
+
+    if (_lastArrivalIndex != -1) {
+        const int32_t diff = _indexDiff(index, _lastArrivalIndex);
+        if (std::abs(diff) <= window) {
+            // Difference between the spacing of the capture timestamps and
+            // the spacing of the frames in the stream.
+            const auto d = (ts - _lastArrivalTs) - diff * _frameDuration;
+            const double d_us = std::abs(chrono::duration<double, micro>(d).count());
+            _jitter += (d_us - _jitter) / 16.0;
+        }
+    }
+    _lastArrivalIndex = index;
+    _lastArrivalTs = ts;
+
+    const int32_t diff = _highestIndex == -1 ? 1 : _indexDiff(index, _highestIndex);
+    if (diff > 0 or -diff > window) {
+        _highestIndex = index;
+    }
+    else if (diff < 0) {
+        _intervalReorderDepth = std::max(_intervalReorderDepth, (size_t)-diff);
+        _reorderDepth = std::max(_reorderDepth, _intervalReorderDepth);
+    }
+
+    const double frame_us = chrono::duration<double, micro>(_frameDuration).count();
+    const size_t jitterFrames = ceil(JITTER_MARGIN * _jitter / frame_us);
+    const size_t wanted = std::min(std::max(_reorderDepth + jitterFrames + 1, _minCapacity), _capacity);
+
+    if (wanted > _target) {
+        DEBUG("target grows to %zu\n", wanted);
+        _target = wanted;
+    }
+
+    if (++_intervalFrames >= ADAPT_INTERVAL) {
+        // Forget the reordering seen before the last interval
+        _reorderDepth = _intervalReorderDepth;
+        _intervalReorderDepth = 0;
+        _intervalFrames = 0;
+
+        if (wanted < _target) {
+            _target--;
+        }
+    }
 }
 
-void OrderedQueue::push(int32_t index, const uint8_t* buf, size_t size, const timestamp_t& ts)
+OrderedQueue::PushResult OrderedQueue::push(int32_t index, const uint8_t* buf, size_t size, const timestamp_t& ts)
 {
     // DEBUG("OrderedQueue::push index=%d\n", index);
     index = (index + _maxIndex) % _maxIndex;
 
+    const auto result = _insert(index, buf, size, ts);
+
+    // Only the first copy of a frame tells us when it could have been used
+    if (_minCapacity > 0 and result != PushResult::Duplicate) {
+        _measureArrival(index, ts);
+    }
+
+    return result;
+}
+
+OrderedQueue::PushResult OrderedQueue::_insert(int32_t index, const uint8_t* buf, size_t size, const timestamp_t& ts)
+{
+
     // First frame makes the index initialisation.
     if (_lastIndexPop == -1) {
         // Equivalent to index - 1 in modulo arithmetic:
         _lastIndexPop = (index + _maxIndex-1) % _maxIndex;
     }
 
-    if (_stock.size() < _capacity) {
-        if (_stock.find(index) != _stock.end()) {
-            // index already exists, duplicated frame
-            // Replace the old one by the new one.
-            // the old one could a an old frame from the previous index loop
+    const int32_t diff = _indexDiff(index, _lastIndexPop);
+
+    if (diff <= 0 and _framesBehind < _window()) {
+        // The frame precedes the one we returned last, it either is a
+        // duplicate or it arrived too late.
+        _framesBehind++;
+
+        if ((_returned[index / 64] >> (index % 64)) & 1) {
             _duplicated++;
-            DEBUG("Duplicated index=%d\n", index);
+            return PushResult::Duplicate;
         }
 
-        OrderedQueueData oqd;
-        oqd.buf.resize(size);
-        oqd.capture_timestamp = ts;
+        _late++;
+        DEBUG("Late index=%d not inserted\n", index);
+        return PushResult::Late;
+    }
+
+    // Distance between the next index to be returned and this one. After
+    // a long run of frames behind, the sender was restarted.
+    size_t distance = diff > 0 ? diff - 1 : _maxIndex;
 
-        copy(buf, buf + size, oqd.buf.begin());
-        _stock[index] = move(oqd);
+    if (distance >= _window() and _size == 0) {
+        // Nothing is waiting, we can restart from this index without losing frames
+        DEBUG("index jump to %d\n", index);
+        _lastIndexPop = (index + _maxIndex-1) % _maxIndex;
+        distance = 0;
+        std::fill(_returned.begin(), _returned.end(), 0);
+    }
+    else if (distance >= _window()) {
+        // Skip over missing frames at the head of the queue to make room,
+        // as pop() would do once the queue is full.
+        const size_t gap = std::min(distance - _window() + 1, _nextOccupied());
+        if (gap > 0) {
+            DEBUG("index jump of %zu\n", gap);
+            for (size_t i = 1; i <= gap; i++) {
+                _setReturned((_lastIndexPop + i) % _maxIndex, false);
+            }
+            _head = (_head + gap) % _window();
+            _lastIndexPop = (_lastIndexPop + gap) % _maxIndex;
+            distance -= gap;
+        }
+    }
+
+    const size_t slot = (_head + distance) % _window();
+
+    if (distance < _window() and _isOccupied(slot)) {
+        // index already exists, duplicated frame
+        // Keep the first one, which can already have been handed out.
+        _duplicated++;
+        return PushResult::Duplicate;
+    }
+    else if (distance < _window() and _size < _capacity) {
+        _setOccupied(slot, true);
+        _size++;
+        _framesBehind = 0;
     }
     else {
+        if (distance >= _window()) {
+            // The frame is so far ahead that the gap preceding it must be
+            // skipped before we can accept it.
+            _overrunPending = true;
+        }
+
         _overruns++;
         if (_overruns < 100) {
-            DEBUG("Overruns (size=%zu) index=%d not inserted\n", _stock.size(), index);
+            DEBUG("Overruns (size=%zu) index=%d not inserted\n", _size, index);
         }
         else if (_overruns == 100) {
             DEBUG("stop displaying Overruns\n");
         }
+        return PushResult::Overrun;
     }
+
+    auto& oqd = _slots[slot];
+    oqd.buf.assign(buf, buf + size);
+    oqd.capture_timestamp = ts;
+    return PushResult::Inserted;
 }
 
 bool OrderedQueue::availableData() const
 {
-    // TODO Wait for filling gaps
-    return _stock.size() > 0;
+    return _size > 0;
 }
 
-OrderedQueueData OrderedQueue::pop(int32_t *returnedIndex)
+bool OrderedQueue::gapDeadline(timestamp_t& deadline) const
 {
-    OrderedQueueData oqd;
-    uint32_t gap = 0;
+    if (_gapWait.count() == 0 or _size == 0 or _isOccupied(_head)) {
+        return false;
+    }
 
-    if (_stock.size() > 0) {
-        int32_t nextIndex = (_lastIndexPop+1) % _maxIndex;
-        bool found = false;
-        while (not found) {
-            try {
-                oqd = move(_stock.at(nextIndex));
-                _stock.erase(nextIndex);
-                _lastIndexPop = nextIndex;
-                if (returnedIndex) *returnedIndex = _lastIndexPop;
-                found = true;
-            }
-            catch (const std::out_of_range&) {
-                if (_stock.size() < _capacity) {
-                    break;
-                }
-                else {
-                    // Search for the new index, starting from the current one
-                    // This could be optimised, but the modulo makes things
-                    // not easy.
-                    gap++;
-                    nextIndex = (nextIndex+1) % _maxIndex;
-                }
-            }
+    // The missing frame should have arrived gap frame durations before the
+    // next one we have.
+    const size_t gap = _nextOccupied();
+    const auto& next = _slots[(_head + gap) % _window()];
+    deadline = next.capture_timestamp - gap * _frameDuration + _gapWait;
+    return true;
+}
+
+const OrderedQueueData* OrderedQueue::pop(int32_t *returnedIndex)
+{
+    if (_size == 0) {
+        return nullptr;
+    }
+
+    size_t gap = 0;
+    if (not _isOccupied(_head)) {
+        timestamp_t deadline;
+        const bool gapTimedOut = gapDeadline(deadline) and
+            deadline <= chrono::system_clock::now();
+
+        if (_size < _target and not _overrunPending and not gapTimedOut) {
+            return nullptr;
+        }
+
+        // Skip over the missing frames to the next one we have
+        gap = _nextOccupied();
+        DEBUG("index jump of %zu\n", gap);
+        for (size_t i = 1; i <= gap; i++) {
+            _setReturned((_lastIndexPop + i) % _maxIndex, false);
         }
     }
 
-    if (gap > 0) {
-        DEBUG("index jump of %d\n", gap);
+    const size_t slot = (_head + gap) % _window();
+    _setOccupied(slot, false);
+    _size--;
+
+    if (_size == 0) {
+        _overrunPending = false;
     }
 
-    return oqd;
+    _lastIndexPop = (_lastIndexPop + 1 + gap) % _maxIndex;
+    _setReturned(_lastIndexPop, true);
+    if (returnedIndex) *returnedIndex = _lastIndexPop;
+
+    _head = (slot + 1) % _window();
+
+    return &_slots[slot];
 }
 
+OrderedQueueStats OrderedQueue::getStats() const
+{
+    OrderedQueueStats stats;
+    stats.size = _size;
+    stats.target = _target;
+    stats.jitter_ms = _jitter / 1000.0;
+    stats.reorder_depth = _reorderDepth;
+    return stats;
+}
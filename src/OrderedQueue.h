@@ -20,7 +20,6 @@
 #pragma once
 
 #include <string>
-#include <map>
 #include <vector>
 #include <chrono>
 #include <cstdint>
@@ -34,30 +33,136 @@ struct OrderedQueueData {
     timestamp_t capture_timestamp;
 };
 
+struct OrderedQueueStats {
+    /* Number of frames waiting in the queue */
+    size_t size = 0;
+    /* Number of frames the queue fills to before a gap is skipped */
+    size_t target = 0;
+    /* Interarrival jitter, in milliseconds */
+    double jitter_ms = 0;
+    /* Largest distance of a reordered frame in the last interval */
+    size_t reorder_depth = 0;
+};
+
 /* An queue that receives indexed frames, potentially out-of-order,
  * which returns the frames in-order.
+ *
+ * The frames are stored in a ring of slots, the slot at _head holding the
+ * frame following the last one returned by pop(). The ring is twice as
+ * large as the capacity, so that frames following a gap still fit until
+ * the queue is full. A bitmap keeps track of which slots are occupied.
  */
 class OrderedQueue
 {
     public:
         /* Indexes of frames must be between 0 and maxIndex.
          * The queue will fill to capacity if there is a gap.
+         * The storage of every slot is preallocated to frameSize bytes.
          */
-        OrderedQueue(int32_t maxIndex, size_t capacity);
+        OrderedQueue(int32_t maxIndex, size_t capacity, size_t frameSize = 0);
 
-        void push(int32_t index, const uint8_t* buf, size_t size, const timestamp_t& ts);
+        /* Also skip a missing frame once gapWait has elapsed after its expected
+         * arrival time, which is derived from the capture timestamp of the next
+         * frame we have. A gapWait of zero disables this, and gaps are only skipped
+         * once the queue is full.
+         */
+        void setGapWait(std::chrono::milliseconds gapWait, std::chrono::milliseconds frameDuration);
+
+        /* Adapt the number of frames the queue fills to before skipping a gap,
+         * between minCapacity and capacity. The target follows the interarrival
+         * jitter and the reordering depth measured on pushed frames. It grows
+         * immediately, and shrinks slowly once the link conditions improve.
+         * A minCapacity of zero disables this, the queue then always fills
+         * to capacity.
+         */
+        void setAdaptiveCapacity(size_t minCapacity, std::chrono::milliseconds frameDuration);
+
+        enum class PushResult {
+            Inserted,
+            /* The frame is already in the queue, or was already returned
+             * by pop(). The first copy is kept. */
+            Duplicate,
+            /* The frame was skipped by pop() before it arrived */
+            Late,
+            /* The queue is full */
+            Overrun,
+        };
+
+        PushResult push(int32_t index, const uint8_t* buf, size_t size, const timestamp_t& ts);
         bool availableData() const;
 
-        /* Return the next buffer, or an empty buffer if none available */
-        OrderedQueueData pop(int32_t *returnedIndex=nullptr);
+        /* If the next frame is missing and setGapWait() is enabled, set deadline
+         * to the time when pop() will skip it and return true. */
+        bool gapDeadline(timestamp_t& deadline) const;
+
+        /* Return the next frame, or nullptr if none available.
+         * The frame stays valid until the next call to push() */
+        const OrderedQueueData* pop(int32_t *returnedIndex=nullptr);
+
+        OrderedQueueStats getStats() const;
 
     private:
         int32_t     _maxIndex;
         size_t      _capacity;
         uint64_t    _duplicated = 0;
         uint64_t    _overruns = 0;
+        uint64_t    _late = 0;
         int32_t     _lastIndexPop = -1;
 
-        std::map<int, OrderedQueueData> _stock;
+        std::chrono::milliseconds _gapWait = std::chrono::milliseconds(0);
+        std::chrono::milliseconds _frameDuration = std::chrono::milliseconds(0);
+
+        /* Adaptive capacity */
+        size_t      _minCapacity = 0;
+        size_t      _target;
+        /* Interarrival jitter as in RFC 3550, in microseconds */
+        double      _jitter = 0;
+        int32_t     _lastArrivalIndex = -1;
+        timestamp_t _lastArrivalTs;
+        int32_t     _highestIndex = -1;
+        size_t      _reorderDepth = 0;
+        size_t      _intervalReorderDepth = 0;
+        size_t      _intervalFrames = 0;
+
+        /* Slot that holds frame _lastIndexPop+1 */
+        size_t      _head = 0;
+        /* Number of occupied slots */
+        size_t      _size = 0;
+        /* A frame could not be inserted because it was too far ahead,
+         * gaps must be skipped until the queue is empty. */
+        bool        _overrunPending = false;
+        /* Number of frames preceding the last returned one that arrived
+         * since a frame was inserted. Frames behind are late or duplicates
+         * from a slower path, unless they keep coming without any frame
+         * ahead, because the sender was restarted. */
+        size_t      _framesBehind = 0;
+
+        std::vector<OrderedQueueData> _slots;
+        std::vector<uint64_t> _occupied;
+
+        /* One bit per index, telling if pop() returned or skipped it the
+         * last time it went past this index. */
+        std::vector<uint64_t> _returned;
+        void _setReturned(int32_t index, bool returned);
+
+        bool _isOccupied(size_t slot) const;
+        void _setOccupied(size_t slot, bool occupied);
+
+        /* Number of slots in the ring */
+        size_t _window() const { return _slots.size(); }
+
+        /* Return the first occupied slot in [begin, end), or end if none */
+        size_t _findOccupied(size_t begin, size_t end) const;
+
+        /* Return the distance from _head to the next occupied slot */
+        size_t _nextOccupied() const;
+
+        /* Return index - reference, between -maxIndex/2 and maxIndex/2 */
+        int32_t _indexDiff(int32_t index, int32_t reference) const;
+
+        PushResult _insert(int32_t index, const uint8_t* buf, size_t size, const timestamp_t& ts);
+
+        /* Update the jitter measurements and the adaptive target */
+        void _measureArrival(int32_t index, const timestamp_t& ts);
 };
 
@@ -138,6 +138,8 @@ bool ZMQ::write_frame(const uint8_t *buf, size_t len)
 
 EDI::EDI() :
     m_time_last_version_sent(chrono::steady_clock::now()),
+    m_edi_tagStarPtr("DSTI"),
+    m_edi_tagpacket(m_edi_conf.tagpacket_alignment),
     m_clock_tai({})
 { }
 
@@ -183,6 +185,16 @@ bool EDI::enabled() const
     return not m_edi_conf.destinations.empty();
 }
 
+bool EDI::get_spreading_stats(edi::Sender::spreading_stats_t& stats) const
+{
+    if (not m_edi_sender or not m_edi_conf.enable_pft) {
+        return false;
+    }
+
+    stats = m_edi_sender->get_spreading_stats();
+    return stats.num_sent > 0;
+}
+
 void EDI::set_tist(bool enable, uint32_t delay_ms, const chrono::system_clock::time_point& ts)
 {
     m_tist = enable;
@@ -201,14 +213,17 @@ void EDI::set_tist(bool enable, uint32_t delay_ms, const chrono::system_clock::t
     m_timestamp += remainder_ms << 14; // Shift ms by 14 to Timestamp level 2
 }
 
+void EDI::set_audio_levels_enabled(bool enabled)
+{
+    m_audio_levels_enabled = enabled;
+}
+
 bool EDI::write_frame(const uint8_t *buf, size_t len)
 {
     if (not m_edi_sender) {
         m_edi_sender = make_shared<edi::Sender>(m_edi_conf);
     }
 
-    edi::TagStarPTR edi_tagStarPtr("DSTI");
-
     m_edi_tagDSTI.stihf = false;
     m_edi_tagDSTI.atstf = m_tist;
 
@@ -225,26 +240,29 @@ bool EDI::write_frame(const uint8_t *buf, size_t len)
 
     edi::TagODRAudioLevels edi_tagAudioLevels(m_audio_left, m_audio_right);
 
-    // We always send in 24ms interval
-    const size_t num_seconds_sent = m_num_frames_sent * 1000 / 24;
-    edi::TagODRVersion edi_tagVersion(m_odr_version_tag, num_seconds_sent);
-
     // The above Tag Items will be assembled into a TAG Packet
-    edi::TagPacket edi_tagpacket(m_edi_conf.tagpacket_alignment);
-
     // put tags *ptr, DETI and all subchannels into one TagPacket
-    edi_tagpacket.tag_items.push_back(&edi_tagStarPtr);
-    edi_tagpacket.tag_items.push_back(&m_edi_tagDSTI);
-    edi_tagpacket.tag_items.push_back(&edi_tagPayload);
-    edi_tagpacket.tag_items.push_back(&edi_tagAudioLevels);
+    m_edi_tagpacket.tag_items.clear();
+    m_edi_tagpacket.tag_items.push_back(&m_edi_tagStarPtr);
+    m_edi_tagpacket.tag_items.push_back(&m_edi_tagDSTI);
+    m_edi_tagpacket.tag_items.push_back(&edi_tagPayload);
+    if (m_audio_levels_enabled) {
+        m_edi_tagpacket.tag_items.push_back(&edi_tagAudioLevels);
+    }
 
-    // Send version information only every 10 seconds to save bandwidth
+    // Send version information only every 10 seconds to save bandwidth.
+    // The tag copies the version string, only create it when needed.
+    optional<edi::TagODRVersion> edi_tagVersion;
     if (m_time_last_version_sent + chrono::seconds(10) < chrono::steady_clock::now()) {
         m_time_last_version_sent += chrono::seconds(10);
-        edi_tagpacket.tag_items.push_back(&edi_tagVersion);
+
+        // We always send in 24ms interval
+        const size_t num_seconds_sent = m_num_frames_sent * 1000 / 24;
+        edi_tagVersion.emplace(m_odr_version_tag, num_seconds_sent);
+        m_edi_tagpacket.tag_items.push_back(&*edi_tagVersion);
     }
 
-    m_edi_sender->write(edi_tagpacket);
+    m_edi_sender->write(m_edi_tagpacket);
 
     m_num_frames_sent++;
 
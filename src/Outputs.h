@@ -24,6 +24,7 @@
 #include <cstdint>
 #include <cstddef>
 #include <cstdio>
+#include <optional>
 #include "common.h"
 #include "zmq.hpp"
 #include "ClockTAI.h"
@@ -143,8 +144,15 @@ class EDI: public Base {
 
         void set_tist(bool enable, uint32_t delay_ms, const std::chrono::system_clock::time_point& ts);
 
+        // Send the audio levels in the ODRa TAG, enabled by default
+        void set_audio_levels_enabled(bool enabled);
+
         bool enabled() const;
 
+        // Get the statistics of the PFT fragment spreading, returns false
+        // if PFT is not used or no fragment was sent yet
+        bool get_spreading_stats(edi::Sender::spreading_stats_t& stats) const;
+
         virtual bool write_frame(const uint8_t *buf, size_t len) override;
 
     private:
@@ -158,11 +166,18 @@ class EDI: public Base {
         std::time_t m_edi_time = 0;
         std::chrono::steady_clock::time_point m_time_last_version_sent;
 
+        edi::TagStarPTR m_edi_tagStarPtr;
         edi::TagDSTI m_edi_tagDSTI;
 
+        // Reused for every frame, so that its list of items is not
+        // allocated again
+        edi::TagPacket m_edi_tagpacket;
+
         ClockTAI m_clock_tai;
         bool m_tist = false;
         uint32_t m_delay_ms = 0;
+
+        bool m_audio_levels_enabled = true;
 };
 
 }
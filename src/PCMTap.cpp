@@ -0,0 +1,124 @@
+/* ------------------------------------------------------------------
+ * Copyright (C) 2019 Matthias P. Braendli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ * -------------------------------------------------------------------
+ */
+
+#include "PCMTap.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// The PCM of the largest AU: 960 samples, with SBR, stereo
+static const size_t MAX_PCM_SIZE = 960 * 2 * 2 * sizeof(int16_t);
+
+// Keep the slots aligned to cache lines
+static const size_t SLOT_SIZE =
+    (sizeof(pcm_tap_slot_t) + MAX_PCM_SIZE + 63) / 64 * 64;
+static const size_t HEADER_SIZE = 64;
+
+static_assert(sizeof(pcm_tap_header_t) <= HEADER_SIZE, "PCM tap header too large");
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+        "The PCM tap needs lock-free atomics to be shared between processes");
+
+PCMTap::PCMTap(const std::string& name, size_t num_slots) :
+    m_name(name),
+    m_num_slots(num_slots)
+{
+    if (num_slots == 0) {
+        throw std::runtime_error("PCM tap needs at least one slot");
+    }
+
+    // Readers still attached to a previous instance keep their mapping
+    shm_unlink(m_name.c_str());
+
+    int fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd == -1) {
+        throw std::runtime_error("PCM tap: shm_open " + m_name + " failed: " + strerror(errno));
+    }
+
+    m_map_size = HEADER_SIZE + m_num_slots * SLOT_SIZE;
+    if (ftruncate(fd, m_map_size) == -1) {
+        const int err = errno;
+        close(fd);
+        shm_unlink(m_name.c_str());
+        throw std::runtime_error("PCM tap: ftruncate failed: " + std::string(strerror(err)));
+    }
+
+    void *map = mmap(nullptr, m_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        const int err = errno;
+        shm_unlink(m_name.c_str());
+        throw std::runtime_error("PCM tap: mmap failed: " + std::string(strerror(err)));
+    }
+    m_map = reinterpret_cast<uint8_t*>(map);
+
+    // ftruncate filled the object with zeros, which is a valid state
+    // for the atomics
+    auto header = reinterpret_cast<pcm_tap_header_t*>(m_map);
+    header->version = PCM_TAP_VERSION;
+    header->num_slots = m_num_slots;
+    header->slot_size = SLOT_SIZE;
+    header->write_index.store(0, std::memory_order_relaxed);
+
+    // Readers check the magic last, once the rest is valid
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header->magic, PCM_TAP_MAGIC, sizeof(header->magic));
+}
+
+PCMTap::~PCMTap()
+{
+    if (m_map) {
+        munmap(m_map, m_map_size);
+        shm_unlink(m_name.c_str());
+    }
+}
+
+void PCMTap::write(const uint8_t *pcm, size_t len,
+        uint64_t frame_seq, uint32_t au_index, bool concealed,
+        const std::chrono::system_clock::time_point& ts,
+        uint32_t sample_rate, uint32_t channels)
+{
+    auto header = reinterpret_cast<pcm_tap_header_t*>(m_map);
+    const uint64_t index = header->write_index.load(std::memory_order_relaxed);
+
+    auto slot = reinterpret_cast<pcm_tap_slot_t*>(
+            m_map + HEADER_SIZE + (index % m_num_slots) * SLOT_SIZE);
+
+    // Mark the slot as being written
+    slot->sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    using namespace std::chrono;
+    len = std::min(len, MAX_PCM_SIZE);
+    slot->frame_seq = frame_seq;
+    slot->au_index = au_index;
+    slot->concealed = concealed ? 1 : 0;
+    slot->timestamp_us = duration_cast<microseconds>(ts.time_since_epoch()).count();
+    slot->sample_rate = sample_rate;
+    slot->channels = channels;
+    slot->pcm_size = len;
+    memcpy(reinterpret_cast<uint8_t*>(slot) + sizeof(pcm_tap_slot_t), pcm, len);
+
+    slot->sequence.store(2 * index + 2, std::memory_order_release);
+    header->write_index.store(index + 1, std::memory_order_release);
+}
+
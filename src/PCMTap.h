@@ -0,0 +1,105 @@
+/* ------------------------------------------------------------------
+ * Copyright (C) 2019 Matthias P. Braendli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ * -------------------------------------------------------------------
+ */
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+/*! \file PCMTap.h
+ *
+ * Publishes the decoded audio in a ring buffer in POSIX shared memory, so
+ * that monitoring tools need not decode the stream again.
+ *
+ * The shared memory object starts with a pcm_tap_header_t, followed by
+ * num_slots slots of slot_size bytes. Every slot starts with a
+ * pcm_tap_slot_t, followed by the interleaved 16-bit PCM of one AU.
+ *
+ * There is a single writer and any number of readers, which never block
+ * the writer. Each slot is protected by a sequence counter: it is odd
+ * while the writer fills the slot. A reader
+ *  1. loads write_index, the number of AUs written so far. AU n is in slot
+ *     n % num_slots, the last one is write_index - 1;
+ *  2. loads the sequence counter of the slot, and retries later if it is
+ *     odd;
+ *  3. copies the slot;
+ *  4. loads the sequence counter again. If it changed, the writer has
+ *     overwritten the slot in the meantime and the copy is invalid.
+ * The counter of a slot that holds AU n is 2*(n+1) once it is complete.
+ */
+
+#define PCM_TAP_MAGIC "ODRPCM\0"
+#define PCM_TAP_VERSION 1
+
+struct pcm_tap_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_slots;
+    /* Size of a slot, including its pcm_tap_slot_t */
+    uint32_t slot_size;
+    uint32_t reserved;
+    /* Number of AUs written since the tap was created */
+    std::atomic<uint64_t> write_index;
+};
+
+struct pcm_tap_slot_t {
+    std::atomic<uint64_t> sequence;
+    /* Number of the superframe the AU belongs to, counted by the decoder,
+     * and index of the AU within the superframe */
+    uint64_t frame_seq;
+    uint32_t au_index;
+    /* 1 if FDK concealed the AU because it was missing or invalid */
+    uint32_t concealed;
+    /* Time the superframe was received, shifted by the position of the AU
+     * within it, in microseconds since the UNIX epoch */
+    int64_t timestamp_us;
+    uint32_t sample_rate;
+    uint32_t channels;
+    /* Size of the PCM that follows, in bytes */
+    uint32_t pcm_size;
+    uint32_t reserved;
+};
+
+class PCMTap {
+    public:
+        /*! Create the shared memory object with the given name, which must
+         * start with a slash, e.g. /odr-pcm. The ring holds num_slots AUs.
+         * An existing object with the same name is replaced.
+         *
+         * Throws a std::runtime_error on failure */
+        PCMTap(const std::string& name, size_t num_slots);
+        PCMTap(const PCMTap& other) = delete;
+        PCMTap& operator=(const PCMTap& other) = delete;
+        ~PCMTap();
+
+        /*! Write the PCM of one AU into the next slot. PCM larger than
+         * a slot is truncated. */
+        void write(const uint8_t *pcm, size_t len,
+                uint64_t frame_seq, uint32_t au_index, bool concealed,
+                const std::chrono::system_clock::time_point& ts,
+                uint32_t sample_rate, uint32_t channels);
+
+    private:
+        std::string m_name;
+        size_t m_num_slots;
+        size_t m_map_size = 0;
+        uint8_t *m_map = nullptr;
+};
+
@@ -113,10 +113,10 @@ vector<uint8_t> PadInterface::request(uint8_t padlen)
         m_padenc_reachable = true;
     }
 
-    vector<uint8_t> buffer(2048);
+    m_buffer.resize(2048);
 
     while (true) {
-        ret = ::recvfrom(m_sock, buffer.data(), buffer.size(), 0, nullptr, nullptr);
+        ret = ::recvfrom(m_sock, m_buffer.data(), m_buffer.size(), 0, nullptr, nullptr);
 
         if (ret == -1) {
             // This suppresses the -Wlogical-op warning
@@ -132,15 +132,11 @@ vector<uint8_t> PadInterface::request(uint8_t padlen)
             return {};
         }
         else if (ret > 0) {
-            buffer.resize(ret);
-
             // We could check where the data comes from, but since we're using UNIX sockets
             // the source is anyway local to the machine.
 
-            if (buffer[0] == MESSAGE_PAD_DATA) {
-                vector<uint8_t> pad_data(buffer.size() - 1);
-                copy(buffer.begin() + 1, buffer.end(), pad_data.begin());
-                return pad_data;
+            if (m_buffer[0] == MESSAGE_PAD_DATA) {
+                return vector<uint8_t>(m_buffer.begin() + 1, m_buffer.begin() + ret);
             }
             else {
                 continue;
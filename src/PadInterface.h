@@ -37,8 +37,14 @@ class PadInterface {
 
         std::vector<uint8_t> request(uint8_t padlen);
 
+        /*! \return the socket on which ODR-PadEnc replies arrive, to be used with poll() */
+        int get_sockfd() const { return m_sock; }
+
     private:
         std::string m_pad_ident;
         int m_sock = -1;
         bool m_padenc_reachable = true;
+
+        // Receive buffer, kept to avoid an allocation on every request
+        std::vector<uint8_t> m_buffer;
 };
@@ -23,6 +23,7 @@
 #include <cstring>
 #include <cerrno>
 #include <cassert>
+#include <cmath>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
@@ -30,6 +31,18 @@
 
 using namespace std;
 
+/* Loudness that could not be measured yet is -inf, which YAML calls null */
+static string lufs_to_yaml(double lufs)
+{
+    if (not isfinite(lufs)) {
+        return "null";
+    }
+    stringstream ss;
+    ss.precision(1);
+    ss << fixed << lufs;
+    return ss.str();
+}
+
 StatsPublisher::StatsPublisher(const string& socket_path) :
     m_socket_path(socket_path)
 {
@@ -76,6 +89,96 @@ void StatsPublisher::update_audio_levels(int16_t audiolevel_left, int16_t audiol
     m_audio_right = audiolevel_right;
 }
 
+void StatsPublisher::update_audio_rms(int16_t rms_left, int16_t rms_right)
+{
+    m_rms_left = rms_left;
+    m_rms_right = rms_right;
+}
+
+void StatsPublisher::update_loudness(double momentary, double shortterm, double integrated)
+{
+    m_loudness_momentary = momentary;
+    m_loudness_shortterm = shortterm;
+    m_loudness_integrated = integrated;
+}
+
+void StatsPublisher::update_superframe_errors(uint64_t header_errors, uint64_t au_errors)
+{
+    m_header_errors = header_errors;
+    m_au_errors = au_errors;
+}
+
+void StatsPublisher::update_reed_solomon(uint64_t corrected, uint64_t uncorrectable)
+{
+    m_rs_enabled = true;
+    m_rs_corrected = corrected;
+    m_rs_uncorrectable = uncorrectable;
+}
+
+void StatsPublisher::update_decoder(uint64_t levels_age, uint64_t num_dropped, double cpu_time)
+{
+    m_levels_age = levels_age;
+    m_decoder_dropped = num_dropped;
+    m_decoder_cpu_time = cpu_time;
+}
+
+void StatsPublisher::update_decoder_errors(uint64_t invalid_header, uint64_t config_failed,
+        uint64_t fill_failed, uint64_t decode_failed, uint64_t concealed)
+{
+    m_decoder_invalid_header = invalid_header;
+    m_decoder_config_failed = config_failed;
+    m_decoder_fill_failed = fill_failed;
+    m_decoder_decode_failed = decode_failed;
+    m_decoder_concealed = concealed;
+}
+
+void StatsPublisher::update_audio_monitor(bool silence, double silence_s,
+        bool stuck, uint64_t stuck_frames, uint64_t num_events)
+{
+    m_silence = silence;
+    m_silence_s = silence_s;
+    m_stuck = stuck;
+    m_stuck_frames = stuck_frames;
+    m_monitor_events = num_events;
+}
+
+void StatsPublisher::update_decoder_config(uint64_t num_reconfigurations, double config_time_ms)
+{
+    m_decoder_reconfigurations = num_reconfigurations;
+    m_decoder_config_time_ms = config_time_ms;
+}
+
+void StatsPublisher::update_edi_spreading(uint64_t num_sent, const uint32_t *bounds_us,
+        const uint64_t *counts, size_t num_bins)
+{
+    m_edi_spreading_enabled = true;
+    m_edi_fragments_sent = num_sent;
+    // The vectors keep their storage after the first update
+    m_edi_lateness_bounds_us.assign(bounds_us, bounds_us + num_bins);
+    m_edi_lateness_counts.assign(counts, counts + num_bins + 1);
+}
+
+void StatsPublisher::update_jitter_buffer(size_t fill, size_t target, double jitter_ms)
+{
+    m_jitter_buffer_fill = fill;
+    m_jitter_buffer_target = target;
+    m_jitter_ms = jitter_ms;
+}
+
+void StatsPublisher::update_input_path(size_t path, uint64_t received, uint64_t lost,
+        uint64_t late, uint64_t duplicates)
+{
+    if (path >= m_input_paths.size()) {
+        m_input_paths.resize(path + 1);
+    }
+
+    auto& p = m_input_paths[path];
+    p.received = received;
+    p.lost = lost;
+    p.late = late;
+    p.duplicates = duplicates;
+}
+
 void StatsPublisher::notify_underrun()
 {
     m_num_underruns++;
@@ -99,8 +202,59 @@ void StatsPublisher::send_stats()
             PACKAGE_VERSION
 #endif
             << "\n";
-    yaml << "audiolevels: { left: " << m_audio_left << ", right: " << m_audio_right << "}\n";
+    yaml << "audiolevels: { left: " << m_audio_left << ", right: " << m_audio_right <<
+        ", rms_left: " << m_rms_left << ", rms_right: " << m_rms_right << "}\n";
+    yaml << "loudness: { momentary: " << lufs_to_yaml(m_loudness_momentary) <<
+        ", shortterm: " << lufs_to_yaml(m_loudness_shortterm) <<
+        ", integrated: " << lufs_to_yaml(m_loudness_integrated) << "}\n";
+    yaml << "decoder: { levels_age: " << m_levels_age << ", dropped: " << m_decoder_dropped <<
+        ", cpu_s: " << m_decoder_cpu_time << "}\n";
+    yaml << "decoder_errors: { invalid_header: " << m_decoder_invalid_header <<
+        ", config_failed: " << m_decoder_config_failed <<
+        ", fill_failed: " << m_decoder_fill_failed <<
+        ", decode_failed: " << m_decoder_decode_failed <<
+        ", concealed: " << m_decoder_concealed << "}\n";
+    yaml << "decoder_config: { reconfigurations: " << m_decoder_reconfigurations <<
+        ", config_time_ms: " << m_decoder_config_time_ms << "}\n";
+    yaml << "audio_monitor: { silence: " << (m_silence ? "true" : "false") <<
+        ", silence_s: " << m_silence_s <<
+        ", stuck: " << (m_stuck ? "true" : "false") <<
+        ", stuck_frames: " << m_stuck_frames <<
+        ", events: " << m_monitor_events << "}\n";
     yaml << "driftcompensation: { underruns: " << m_num_underruns << ", overruns: " << m_num_overruns << "}\n";
+    yaml << "jitterbuffer: { fill: " << m_jitter_buffer_fill << ", target: " << m_jitter_buffer_target <<
+        ", jitter_ms: " << m_jitter_ms << "}\n";
+
+    yaml << "superframes: { header_errors: " << m_header_errors <<
+        ", au_errors: " << m_au_errors << "}\n";
+
+    if (m_rs_enabled) {
+        yaml << "reedsolomon: { corrected: " << m_rs_corrected <<
+            ", uncorrectable: " << m_rs_uncorrectable << "}\n";
+    }
+
+    if (m_edi_spreading_enabled) {
+        yaml << "edi_spreading: { fragments: " << m_edi_fragments_sent << ", late_us: {";
+        for (size_t i = 0; i < m_edi_lateness_counts.size(); i++) {
+            yaml << (i == 0 ? " " : ", ");
+            if (i < m_edi_lateness_bounds_us.size()) {
+                yaml << m_edi_lateness_bounds_us[i];
+            }
+            else {
+                yaml << "inf";
+            }
+            yaml << ": " << m_edi_lateness_counts[i];
+        }
+        yaml << "}}\n";
+    }
+
+    if (not m_input_paths.empty()) {
+        yaml << "inputpaths:\n";
+        for (const auto& p : m_input_paths) {
+            yaml << "  - { received: " << p.received << ", lost: " << p.lost <<
+                ", late: " << p.late << ", duplicates: " << p.duplicates << "}\n";
+        }
+    }
 
     const auto yamlstr = yaml.str();
 
@@ -139,4 +293,6 @@ void StatsPublisher::send_stats()
 
     m_audio_left = 0;
     m_audio_right = 0;
+    m_rms_left = 0;
+    m_rms_right = 0;
 }
@@ -21,6 +21,8 @@
 #include <cstdint>
 #include <cstddef>
 #include <cstdio>
+#include <vector>
+#include <cmath>
 
 /*! \file StatsPublish.h
  *
@@ -41,6 +43,57 @@ class StatsPublisher {
         /*! Update peak audio level information */
         void update_audio_levels(int16_t audiolevel_left, int16_t audiolevel_right);
 
+        /*! Update RMS audio level information */
+        void update_audio_rms(int16_t rms_left, int16_t rms_right);
+
+        /*! Update the EBU R128 momentary, short-term and integrated loudness,
+         * in LUFS */
+        void update_loudness(double momentary, double shortterm, double integrated);
+
+        /*! Update the number of superframes with an invalid header, and
+         * the number of AUs with a CRC error */
+        void update_superframe_errors(uint64_t header_errors, uint64_t au_errors);
+
+        /*! Update the number of superframe Reed-Solomon codewords that were
+         * corrected, and that had too many errors to be corrected */
+        void update_reed_solomon(uint64_t corrected, uint64_t uncorrectable);
+
+        /*! Update the number of superframes the audio levels lag behind,
+         * the number of superframes the decoder had to drop, and the CPU
+         * time the decoder used, in seconds */
+        void update_decoder(uint64_t levels_age, uint64_t num_dropped, double cpu_time);
+
+        /*! Update the decoder error counters: superframes with an invalid
+         * header, failed decoder configurations, AUs that could not be
+         * filled into or decoded by the decoder, and AUs that were concealed */
+        void update_decoder_errors(uint64_t invalid_header, uint64_t config_failed,
+                uint64_t fill_failed, uint64_t decode_failed, uint64_t concealed);
+
+        /*! Update the number of times the decoder was set up again after an
+         * audio mode change, and the time the last set up took, in ms */
+        void update_decoder_config(uint64_t num_reconfigurations, double config_time_ms);
+
+        /*! Update the state of the silence and stuck encoder alarms, the
+         * duration of the current silence in seconds, the number of repeated
+         * superframes, and the number of alarm events so far */
+        void update_audio_monitor(bool silence, double silence_s,
+                bool stuck, uint64_t stuck_frames, uint64_t num_events);
+
+        /*! Update the number of PFT fragments the EDI output sent, and the
+         * histogram of how late they were sent. bounds_us contains the
+         * upper bounds of the num_bins bins in microseconds, counts has
+         * one more entry for the fragments later than the last bound. */
+        void update_edi_spreading(uint64_t num_sent, const uint32_t *bounds_us,
+                const uint64_t *counts, size_t num_bins);
+
+        /*! Update jitter buffer fill level, adaptive target size and
+         * measured interarrival jitter */
+        void update_jitter_buffer(size_t fill, size_t target, double jitter_ms);
+
+        /*! Update the counters of the input path with the given index */
+        void update_input_path(size_t path, uint64_t received, uint64_t lost,
+                uint64_t late, uint64_t duplicates);
+
         /*! Increments the underrun counter */
         void notify_underrun();
 
@@ -59,6 +112,55 @@ class StatsPublisher {
 
         int16_t m_audio_left = 0;
         int16_t m_audio_right = 0;
+        int16_t m_rms_left = 0;
+        int16_t m_rms_right = 0;
+
+        double m_loudness_momentary = -HUGE_VAL;
+        double m_loudness_shortterm = -HUGE_VAL;
+        double m_loudness_integrated = -HUGE_VAL;
+
+        uint64_t m_header_errors = 0;
+        uint64_t m_au_errors = 0;
+
+        bool m_rs_enabled = false;
+        uint64_t m_rs_corrected = 0;
+        uint64_t m_rs_uncorrectable = 0;
+
+        uint64_t m_levels_age = 0;
+        uint64_t m_decoder_dropped = 0;
+        double m_decoder_cpu_time = 0;
+
+        uint64_t m_decoder_invalid_header = 0;
+        uint64_t m_decoder_config_failed = 0;
+        uint64_t m_decoder_fill_failed = 0;
+        uint64_t m_decoder_decode_failed = 0;
+        uint64_t m_decoder_concealed = 0;
+
+        uint64_t m_decoder_reconfigurations = 0;
+        double m_decoder_config_time_ms = 0;
+
+        bool m_silence = false;
+        double m_silence_s = 0;
+        bool m_stuck = false;
+        uint64_t m_stuck_frames = 0;
+        uint64_t m_monitor_events = 0;
+
+        bool m_edi_spreading_enabled = false;
+        uint64_t m_edi_fragments_sent = 0;
+        std::vector<uint32_t> m_edi_lateness_bounds_us;
+        std::vector<uint64_t> m_edi_lateness_counts;
+
+        size_t m_jitter_buffer_fill = 0;
+        size_t m_jitter_buffer_target = 0;
+        double m_jitter_ms = 0;
+
+        struct input_path_t {
+            uint64_t received = 0;
+            uint64_t lost = 0;
+            uint64_t late = 0;
+            uint64_t duplicates = 0;
+        };
+        std::vector<input_path_t> m_input_paths;
 
         size_t m_num_underruns = 0;
         size_t m_num_overruns = 0;
@@ -0,0 +1,146 @@
+/* ------------------------------------------------------------------
+ * Copyright (C) 2019 Matthias P. Braendli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ * -------------------------------------------------------------------
+ */
+
+#include "SuperframeCheck.h"
+
+// Fire code G(x) = x^16 + x^14 + x^13 + x^12 + x^11 + x^5 + x^3 + x^2 + x + 1
+static const uint16_t FIRE_CODE_POLY = 0x782F;
+
+// CRC-16-CCITT G(x) = x^16 + x^12 + x^5 + 1
+static const uint16_t AU_CRC_POLY = 0x1021;
+
+// The fire code covers the 9 bytes following it
+static const size_t FIRE_CODE_LEN = 2;
+static const size_t FIRE_CODE_DATA_LEN = 9;
+
+CRC16::CRC16(uint16_t poly)
+{
+    for (int b = 0; b < 256; b++) {
+        uint16_t crc = b << 8;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ poly : crc << 1;
+        }
+        m_table[0][b] = crc;
+    }
+
+    // m_table[k] gives the CRC of a byte followed by k zero bytes
+    for (int k = 1; k < 8; k++) {
+        for (int b = 0; b < 256; b++) {
+            const uint16_t prev = m_table[k-1][b];
+            m_table[k][b] = (prev << 8) ^ m_table[0][prev >> 8];
+        }
+    }
+}
+
+uint16_t CRC16::compute(uint16_t crc, const uint8_t *data, size_t len) const
+{
+    while (len >= 8) {
+        crc ^= data[0] << 8 | data[1];
+        crc = m_table[7][crc >> 8] ^ m_table[6][crc & 0xFF] ^
+              m_table[5][data[2]] ^ m_table[4][data[3]] ^
+              m_table[3][data[4]] ^ m_table[2][data[5]] ^
+              m_table[1][data[6]] ^ m_table[0][data[7]];
+        data += 8;
+        len -= 8;
+    }
+
+    while (len--) {
+        crc = (crc << 8) ^ m_table[0][(crc >> 8) ^ *data++];
+    }
+
+    return crc;
+}
+
+bool superframe_get_aus(const uint8_t *data, size_t len, superframe_aus_t& aus)
+{
+    // Header up to the AU starts of the largest number of AUs
+    if (len < 11) {
+        return false;
+    }
+
+    const bool dac_rate = data[2] & 0x40;
+    const bool sbr_flag = data[2] & 0x20;
+
+    int *au_start = aus.au_start;
+    const int num_aus = dac_rate ? (sbr_flag ? 3 : 6) : (sbr_flag ? 2 : 4);
+    aus.num_aus = num_aus;
+
+    au_start[0] = dac_rate ? (sbr_flag ? 6 : 11) : (sbr_flag ? 5 : 8);
+    au_start[1] = data[3] << 4 | data[4] >> 4;
+
+    if (num_aus >= 3) {
+        au_start[2] = (data[4] & 0x0F) << 8 | data[5];
+    }
+
+    if (num_aus >= 4) {
+        au_start[3] = data[6] << 4 | data[7] >> 4;
+    }
+
+    if (num_aus == 6) {
+        au_start[4] = (data[7] & 0x0F) << 8 | data[8];
+        au_start[5] = data[9] << 4 | data[10] >> 4;
+    }
+
+    au_start[num_aus] = len; // end of the buffer
+
+    for (int i = 0; i < num_aus; i++) {
+        if (au_start[i] + AU_CRCLEN > au_start[i+1]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+SuperframeCheck::SuperframeCheck() :
+    m_fire_code(FIRE_CODE_POLY),
+    m_au_crc(AU_CRC_POLY)
+{ }
+
+SuperframeCheck::result_t SuperframeCheck::check(const uint8_t *data, size_t len) const
+{
+    result_t r;
+
+    if (len < FIRE_CODE_LEN + FIRE_CODE_DATA_LEN) {
+        return r;
+    }
+
+    const uint16_t fire_code = data[0] << 8 | data[1];
+    if (m_fire_code.compute(0x0000, data + FIRE_CODE_LEN, FIRE_CODE_DATA_LEN) != fire_code or
+            not superframe_get_aus(data, len, r.aus)) {
+        return r;
+    }
+    r.header_ok = true;
+
+    for (int i = 0; i < r.aus.num_aus; i++) {
+        const uint8_t *au = data + r.aus.au_start[i];
+        const size_t au_len = r.aus.au_start[i+1] - r.aus.au_start[i] - AU_CRCLEN;
+
+        const uint16_t au_crc = au[au_len] << 8 | au[au_len + 1];
+        const uint16_t crc = ~m_au_crc.compute(0xFFFF, au, au_len);
+
+        if (crc == au_crc) {
+            r.au_valid |= 1 << i;
+        }
+        else {
+            r.au_errors++;
+        }
+    }
+
+    return r;
+}
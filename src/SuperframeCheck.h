@@ -0,0 +1,81 @@
+/* ------------------------------------------------------------------
+ * Copyright (C) 2019 Matthias P. Braendli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ * -------------------------------------------------------------------
+ */
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+/*! \file SuperframeCheck.h
+ *
+ * Validation of the DAB+ superframe header fire code and of the CRC of
+ * every AU, as defined in ETSI TS 102 563.
+ */
+
+/*! CRC-16 with a non-reflected polynomial, computed eight bytes at
+ *  a time with sliced tables */
+class CRC16 {
+    public:
+        CRC16(uint16_t poly);
+
+        uint16_t compute(uint16_t crc, const uint8_t *data, size_t len) const;
+
+    private:
+        uint16_t m_table[8][256];
+};
+
+/* Maximum number of AUs in a superframe */
+#define SUPERFRAME_MAX_AUS 6
+
+/* Length of the CRC following each AU */
+#define AU_CRCLEN 2
+
+struct superframe_aus_t {
+    int num_aus = 0;
+    /* Start of every AU, and the end of the last one */
+    int au_start[SUPERFRAME_MAX_AUS + 1] = {};
+};
+
+/*! Read the AU boundaries from the superframe header.
+ *  len is the size of the superframe without Reed-Solomon data.
+ *
+ * \return false if the AUs are not in order or do not fit in len
+ */
+bool superframe_get_aus(const uint8_t *data, size_t len, superframe_aus_t& aus);
+
+class SuperframeCheck {
+    public:
+        SuperframeCheck();
+
+        struct result_t {
+            /* The fire code is valid, and the AU starts are consistent */
+            bool header_ok = false;
+            superframe_aus_t aus;
+            /* Bit i is set if AU i has a valid CRC */
+            uint32_t au_valid = 0;
+            /* Number of AUs with a CRC error */
+            int au_errors = 0;
+        };
+
+        /*! Check a superframe without its Reed-Solomon data. The AUs are
+         *  only checked if the fire code is valid. */
+        result_t check(const uint8_t *data, size_t len) const;
+
+    private:
+        CRC16 m_fire_code;
+        CRC16 m_au_crc;
+};
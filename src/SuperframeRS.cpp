@@ -0,0 +1,105 @@
+/* ------------------------------------------------------------------
+ * Copyright (C) 2019 Matthias P. Braendli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ * -------------------------------------------------------------------
+ */
+
+#include "SuperframeRS.h"
+#include <stdexcept>
+#include <algorithm>
+
+using namespace std;
+
+// Field generator polynomial x^8 + x^4 + x^3 + x^2 + 1
+static const int GF_POLY = 0x11D;
+
+SuperframeRS::SuperframeRS() :
+    // The ReedSolomon class decodes in place when reversed
+    m_rs(N, K, true, GF_POLY, 0, 1)
+{
+    uint8_t gf_exp[255];
+    uint8_t gf_log[256] = {};
+
+    int x = 1;
+    for (int i = 0; i < 255; i++) {
+        gf_exp[i] = x;
+        gf_log[x] = i;
+        x <<= 1;
+        if (x & 0x100) {
+            x ^= GF_POLY;
+        }
+    }
+
+    for (size_t r = 0; r < NROOTS; r++) {
+        m_mul[r][0] = 0;
+        for (int v = 1; v < 256; v++) {
+            m_mul[r][v] = gf_exp[(gf_log[v] + r) % 255];
+        }
+    }
+}
+
+SuperframeRS::result_t SuperframeRS::correct(uint8_t *superframe, size_t len)
+{
+    if (len % N != 0) {
+        throw invalid_argument("SuperframeRS: length not multiple of 120");
+    }
+
+    const size_t s = len / N;
+    m_syndromes.assign(NROOTS * s, 0);
+
+    // Horner's scheme over the rows, S_r = S_r * alpha^r + c_j, for all
+    // codewords at once
+    for (size_t r = 0; r < NROOTS; r++) {
+        uint8_t *syn = m_syndromes.data() + r * s;
+        const uint8_t *mul = m_mul[r];
+
+        for (size_t j = 0; j < N; j++) {
+            const uint8_t *row = superframe + j * s;
+            for (size_t k = 0; k < s; k++) {
+                syn[k] = mul[syn[k]] ^ row[k];
+            }
+        }
+    }
+
+    result_t result;
+
+    for (size_t k = 0; k < s; k++) {
+        bool error = false;
+        for (size_t r = 0; r < NROOTS; r++) {
+            error |= m_syndromes[r * s + k] != 0;
+        }
+
+        if (not error) {
+            continue;
+        }
+
+        for (size_t j = 0; j < N; j++) {
+            m_codeword[j] = superframe[k + j * s];
+        }
+
+        const int ret = m_rs.encode(m_codeword, N);
+        if (ret < 0) {
+            result.uncorrectable++;
+        }
+        else {
+            for (size_t j = 0; j < N; j++) {
+                superframe[k + j * s] = m_codeword[j];
+            }
+            result.corrected++;
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,66 @@
+/* ------------------------------------------------------------------
+ * Copyright (C) 2019 Matthias P. Braendli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ * -------------------------------------------------------------------
+ */
+
+#pragma once
+#include "ReedSolomon.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/*! \file SuperframeRS.h
+ *
+ * Checks and corrects the RS(120,110) outer error protection of DAB+
+ * superframes, as defined in ETSI TS 102 563.
+ *
+ * A superframe of s*120 bytes holds s interleaved codewords, codeword k
+ * consisting of the bytes k + s*j, j = 0..119. The syndromes of all
+ * codewords are therefore computed together, one row of s bytes at
+ * a time, and only the codewords with errors are decoded.
+ */
+class SuperframeRS {
+    public:
+        SuperframeRS();
+        SuperframeRS(const SuperframeRS&) = delete;
+        SuperframeRS& operator=(const SuperframeRS&) = delete;
+
+        struct result_t {
+            /* Codewords that had errors which were corrected */
+            size_t corrected = 0;
+            /* Codewords with too many errors to be corrected */
+            size_t uncorrectable = 0;
+        };
+
+        /*! Check the superframe and correct it in place. len must be
+         *  a multiple of 120 */
+        result_t correct(uint8_t *superframe, size_t len);
+
+    private:
+        static const size_t N = 120;
+        static const size_t K = 110;
+        static const size_t NROOTS = N - K;
+
+        ReedSolomon m_rs;
+
+        /* Multiplication by the generator roots alpha^r, r = 0..9 */
+        uint8_t m_mul[NROOTS][256];
+
+        /* NROOTS syndromes of every codeword */
+        std::vector<uint8_t> m_syndromes;
+
+        uint8_t m_codeword[N];
+};
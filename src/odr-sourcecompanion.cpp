@@ -30,6 +30,10 @@
 #include "Outputs.h"
 #include "AACDecoder.h"
 #include "StatsPublish.h"
+#include "SuperframeRS.h"
+#include "SuperframeCheck.h"
+#include "PCMTap.h"
+#include "AudioMonitor.h"
 #include "PadInterface.h"
 #include <sys/time.h>
 #include <sys/types.h>
@@ -43,6 +47,7 @@ extern "C" {
 #include <stdexcept>
 #include <vector>
 #include <deque>
+#include <algorithm>
 #include <chrono>
 #include <thread>
 #include <string>
@@ -55,6 +60,8 @@ extern "C" {
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <cerrno>
 
 
 using namespace std;
@@ -76,10 +83,18 @@ void usage(const char* name) {
     "          and DAB+ specific options are set (-b -c -r --aaclc --sbr --ps)\n"
     "        * PAD Data can be send to the encoder with the options --pad-port --pad --pad-socket\n"
     "     -I, --input-uri=URI                      Input URI. (Supported: 'udp://...')\n"
+    "                                              Can be given twice, if the encoder sends the same\n"
+    "                                              stream over two networks.\n"
     "         --control-uri=URI                    Output control URI (Supported: 'udp://...')\n"
     "         --timeout=ms                         Maximum frame waiting time, in milliseconds (def=2000)\n"  
     "         --pad-port=port                      Port opened for PAD Frame requests (def=0 not opened)\n"
     "         --jitter-size=nbFrames               Jitter buffer size, in 24ms frames (def=40)\n"
+    "         --jitter-min=nbFrames                Adapt the jitter buffer size to the measured jitter,\n"
+    "                                              between this size and --jitter-size (def=0 disabled)\n"
+    "         --gap-wait=ms                        Time to wait for a missing frame before skipping it\n"
+    "                                              (def=0 wait until the jitter buffer is full)\n"
+    "         --rs-correct                         Check the Reed-Solomon parity of every superframe,\n"
+    "                                              and correct the errors where possible\n"
     "         --version                            Print version information and quit\n"
     "   Encoder parameters:\n"
     "     -b, --bitrate={ 8, 16, ..., 192 }    Output bitrate in kbps. Must be a multiple of 8.\n"
@@ -94,6 +109,10 @@ void usage(const char* name) {
     "                                          If more than one ZMQ output is given, the socket\n"
     "                                          will be connected to all listed endpoints.\n"
     "     -e, --edi=URI                        EDI output uri, (e.g. 'tcp://localhost:7000')\n"
+    "         --stream=INDEX                   When the STI frames carry several streams, the following\n"
+    "                                          -o and -e options apply to the stream with this index (def=0).\n"
+    "                                          Stream 0 is the one the encoder parameters apply to, and\n"
+    "                                          the one shown by -l and -S.\n"
     "     -T, --timestamp-delay=DELAY_MS       Enabled timestamps in EDI (requires TAI clock bulletin download) and\n"
     "                                          add a delay (in milliseconds) to the timestamps carried in EDI\n"
     "         --startup-check=SCRIPT_PATH      Before starting, run the given script, and only start if it returns 0.\n"
@@ -101,6 +120,18 @@ void usage(const char* name) {
     "     -p, --pad=BYTES                      Set PAD size in bytes.\n"
     "     -P, --pad-socket=IDENTIFIER          Use the given identifier to communicate with ODR-PadEnc.\n"
     "     -l, --level                          Show peak audio level indication.\n"
+    "         --decode-interval=N              Decode one out of N superframes to measure the audio levels (def=1).\n"
+    "                                          Larger values save CPU, the levels are then held between two\n"
+    "                                          decoded superframes. 0 disables decoding and audio levels.\n"
+    "         --pcm-tap=NAME                   Write the decoded audio to a ring buffer in the POSIX shared\n"
+    "                                          memory object NAME (e.g. /odr-pcm), for monitoring tools.\n"
+    "                                          Streams other than 0 use NAME-INDEX. See src/PCMTap.h.\n"
+    "         --silence-level=DBFS             Peak level below which the audio is considered silent (def=-60).\n"
+    "         --silence-duration=SECONDS       Raise the silence alarm after this time, 0 disables it (def=10).\n"
+    "         --stuck-frames=N                 Raise the stuck encoder alarm after N identical superframes,\n"
+    "                                          0 disables it (def=25).\n"
+    "         --alarm-hook=COMMAND             Run COMMAND on every alarm event, with the event (silence_start,\n"
+    "                                          silence_end, stuck_start, stuck_end) and the stream index as arguments.\n"
     "     -S, --stats=SOCKET_NAME              Connect to the specified UNIX Datagram socket and send statistics.\n"
     "                                          This allows external tools to collect audio and drift compensation stats.\n"
     "\n"
@@ -109,10 +140,39 @@ void usage(const char* name) {
 }
 
 
+/* Number of AUs in the PCM tap, about 10 seconds of audio without SBR */
+static const size_t PCM_TAP_NUM_SLOTS = 512;
+
 #define no_argument 0
 #define required_argument 1
 #define optional_argument 2
 
+/* One of the streams received from the encoder, with its outputs */
+struct Service {
+    size_t stream = 0;
+
+    vector<string> output_uris;
+    vector<string> edi_output_uris;
+
+    shared_ptr<Output::ZMQ> zmq_output;
+    Output::EDI edi_output;
+    AACDecoderThread decoder;
+
+    SuperframeRS rs;
+    uint64_t rs_corrected = 0;
+    uint64_t rs_uncorrectable = 0;
+
+    AudioMonitor monitor;
+
+    SuperframeCheck check;
+    uint64_t header_errors = 0;
+    uint64_t au_errors = 0;
+
+    std::vector<uint8_t> outbuf;
+    size_t numOutBytes = 0;
+    chrono::system_clock::time_point ts;
+};
+
 int main(int argc, char *argv[])
 {
     // Version handling is done very early to ensure nothing else but the version gets printed out
@@ -127,15 +187,18 @@ int main(int argc, char *argv[])
         return 0;
     }
 
-    std::string avt_input_uri = "";
+    std::vector<std::string> avt_input_uris;
     std::string avt_output_uri = "";
     int32_t avt_timeout = 2000;
     uint32_t avt_pad_port = 0;
     size_t avt_jitterBufferSize = 40;
+    int32_t avt_gapWaitMs = 0;
+    size_t avt_jitterBufferMinSize = 0;
 
-    std::vector<std::string> output_uris;
+    /* The first service is for stream 0, and always exists */
+    std::deque<Service> services(1);
+    Service *current_service = &services.front();
 
-    AACDecoder decoder;
     unique_ptr<StatsPublisher> stats_publisher;
 
     /* For MOT Slideshow and DLS insertion */
@@ -145,6 +208,10 @@ int main(int argc, char *argv[])
 
     /* Whether to show the 'sox'-like measurement */
     bool show_level = false;
+    unsigned int decode_interval = 1;
+    bool rs_correct = false;
+    string pcm_tap_name;
+    AudioMonitor::config_t monitor_config;
 
     /* If not empty, send stats over UNIX DGRAM socket */
     string send_stats_to = "";
@@ -164,12 +231,22 @@ int main(int argc, char *argv[])
         {"stats",                  required_argument,  0, 'S'},
         {"secret-key",             required_argument,  0, 'k'},
         {"startup-check",          required_argument,  0, 10 },
+        {"stream",                 required_argument,  0, 13 },
         {"identifier",             required_argument,  0,  3 },
         {"input-uri",              required_argument,  0, 'I'},
         {"control-uri",            required_argument,  0,  6 },
         {"timeout",                required_argument,  0,  7 },
         {"pad-port",               required_argument,  0,  8 },
         {"jitter-size",            required_argument,  0,  9 },
+        {"gap-wait",               required_argument,  0, 11 },
+        {"jitter-min",             required_argument,  0, 12 },
+        {"decode-interval",        required_argument,  0, 14 },
+        {"rs-correct",             no_argument,        0, 15 },
+        {"pcm-tap",                required_argument,  0, 16 },
+        {"silence-level",          required_argument,  0, 17 },
+        {"silence-duration",       required_argument,  0, 18 },
+        {"stuck-frames",           required_argument,  0, 19 },
+        {"alarm-hook",             required_argument,  0, 20 },
         {"aaclc",                  no_argument,        0,  0 },
         {"help",                   no_argument,        0, 'h'},
         {"level",                  no_argument,        0, 'l'},
@@ -201,7 +278,6 @@ int main(int argc, char *argv[])
 
     string identifier;
 
-    vector<string> edi_output_uris;
     bool tist_enabled = false;
     uint32_t tist_delay_ms = 0;
 
@@ -243,7 +319,7 @@ int main(int argc, char *argv[])
             channels = stoi(optarg);
             break;
         case 'e':
-            edi_output_uris.push_back(optarg);
+            current_service->edi_output_uris.push_back(optarg);
             break;
         case 'T':
             tist_enabled = true;
@@ -256,7 +332,7 @@ int main(int argc, char *argv[])
             show_level = true;
             break;
         case 'o':
-            output_uris.push_back(optarg);
+            current_service->output_uris.push_back(optarg);
             break;
         case 'p':
             padlen = stoi(optarg);
@@ -271,7 +347,7 @@ int main(int argc, char *argv[])
             send_stats_to = optarg;
             break;
         case 'I':
-            avt_input_uri = optarg;
+            avt_input_uris.push_back(optarg);
             fprintf(stderr, "AVT Encoder Mode\n");
             break;
         case 6:
@@ -292,6 +368,77 @@ int main(int argc, char *argv[])
         case 10: // --startup-check
             startupcheck = optarg;
             break;
+        case 11: // --gap-wait
+            avt_gapWaitMs = stoi(optarg);
+            if (avt_gapWaitMs < 0) {
+                fprintf(stderr, "Invalid gap wait time\n");
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 12: // --jitter-min
+            avt_jitterBufferMinSize = stoi(optarg);
+            break;
+        case 14: // --decode-interval
+            {
+                const int interval = stoi(optarg);
+                if (interval < 0) {
+                    fprintf(stderr, "Invalid decode interval\n");
+                    usage(argv[0]);
+                    return 1;
+                }
+                decode_interval = interval;
+            }
+            break;
+        case 15: // --rs-correct
+            rs_correct = true;
+            break;
+        case 16: // --pcm-tap
+            pcm_tap_name = optarg;
+            break;
+        case 17: // --silence-level
+            monitor_config.silence_level_dbfs = stod(optarg);
+            break;
+        case 18: // --silence-duration
+            monitor_config.silence_duration_s = stod(optarg);
+            break;
+        case 19: // --stuck-frames
+            {
+                const int frames = stoi(optarg);
+                if (frames < 0) {
+                    fprintf(stderr, "Invalid number of stuck frames\n");
+                    usage(argv[0]);
+                    return 1;
+                }
+                monitor_config.stuck_frames = frames;
+            }
+            break;
+        case 20: // --alarm-hook
+            monitor_config.hook = optarg;
+            break;
+        case 13: // --stream
+            {
+                const int stream = stoi(optarg);
+                if (stream < 0 or stream > 0x7FF) {
+                    fprintf(stderr, "Invalid stream index\n");
+                    usage(argv[0]);
+                    return 1;
+                }
+
+                current_service = nullptr;
+                for (auto& service : services) {
+                    if (service.stream == (size_t)stream) {
+                        current_service = &service;
+                    }
+                }
+
+                if (current_service == nullptr) {
+                    services.emplace_back();
+                    current_service = &services.back();
+                    current_service->stream = stream;
+                }
+            }
+            break;
         case '?':
         case 'h':
             usage(argv[0]);
@@ -304,11 +451,27 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    if (avt_input_uri.empty()) {
+    if (avt_input_uris.empty()) {
         fprintf(stderr, "No input URI defined\n");
         return 1;
     }
 
+    if (avt_input_uris.size() > 2) {
+        fprintf(stderr, "At most two input URIs can be given\n");
+        return 1;
+    }
+
+    if (avt_jitterBufferSize < 1 or avt_jitterBufferSize > MAX_JITTER_BUFFER_SIZE) {
+        fprintf(stderr, "Jitter buffer size must be between 1 and %d\n",
+                MAX_JITTER_BUFFER_SIZE);
+        return 1;
+    }
+
+    if (avt_jitterBufferMinSize > avt_jitterBufferSize) {
+        fprintf(stderr, "Minimum jitter buffer size larger than jitter buffer size\n");
+        return 1;
+    }
+
     if (not startupcheck.empty()) {
         etiLog.level(info) << "Running startup check '" << startupcheck << "'";
         int wstatus = system(startupcheck.c_str());
@@ -328,60 +491,93 @@ int main(int argc, char *argv[])
         }
     }
 
-    shared_ptr<Output::ZMQ> zmq_output;
-    Output::EDI edi_output;
+    bool have_outputs = false;
+    for (const auto& service : services) {
+        have_outputs |= not service.output_uris.empty();
+        have_outputs |= not service.edi_output_uris.empty();
+    }
 
-    if (output_uris.empty() and edi_output_uris.empty()) {
+    if (not have_outputs) {
         fprintf(stderr, "No output URIs defined\n");
         return 1;
     }
 
-    for (const auto& uri : output_uris) {
-        if (not zmq_output) {
-            zmq_output = make_shared<Output::ZMQ>();
-        }
+    for (auto& service : services) {
+        for (const auto& uri : service.output_uris) {
+            if (not service.zmq_output) {
+                service.zmq_output = make_shared<Output::ZMQ>();
+            }
 
-        zmq_output->connect(uri.c_str(), keyfile);
-    }
+            service.zmq_output->connect(uri.c_str(), keyfile);
+        }
 
-    for (const auto& uri : edi_output_uris) {
-        if (uri.compare(0, 6, "tcp://") == 0 or
-            uri.compare(0, 6, "udp://") == 0) {
-            auto host_port_sep_ix = uri.find(':', 6);
-            if (host_port_sep_ix != string::npos) {
-                auto host = uri.substr(6, host_port_sep_ix - 6);
-                auto port = std::stoi(uri.substr(host_port_sep_ix + 1));
-
-                auto proto = uri.substr(0, 3);
-                if (proto == "tcp") {
-                    edi_output.add_tcp_destination(host, port);
-                }
-                else if (proto == "udp") {
-                    edi_output.add_udp_destination(host, port);
+        for (const auto& uri : service.edi_output_uris) {
+            if (uri.compare(0, 6, "tcp://") == 0 or
+                uri.compare(0, 6, "udp://") == 0) {
+                auto host_port_sep_ix = uri.find(':', 6);
+                if (host_port_sep_ix != string::npos) {
+                    auto host = uri.substr(6, host_port_sep_ix - 6);
+                    auto port = std::stoi(uri.substr(host_port_sep_ix + 1));
+
+                    auto proto = uri.substr(0, 3);
+                    if (proto == "tcp") {
+                        service.edi_output.add_tcp_destination(host, port);
+                    }
+                    else if (proto == "udp") {
+                        service.edi_output.add_udp_destination(host, port);
+                    }
+                    else {
+                        throw logic_error("unhandled proto");
+                    }
                 }
                 else {
-                    throw logic_error("unhandled proto");
+                    fprintf(stderr, "Invalid EDI URL host!\n");
                 }
             }
             else {
-                fprintf(stderr, "Invalid EDI URL host!\n");
+                fprintf(stderr, "Invalid EDI protocol!\n");
             }
         }
-        else {
-            fprintf(stderr, "Invalid EDI protocol!\n");
-        }
-    }
 
-    if (not edi_output_uris.empty()) {
-        stringstream ss;
-        ss << PACKAGE_NAME << " " <<
+        if (not service.edi_output_uris.empty()) {
+            stringstream ss;
+            ss << PACKAGE_NAME << " " <<
 #if defined(GITVERSION)
-            GITVERSION <<
+                GITVERSION <<
 #else
-            PACKAGE_VERSION <<
+                PACKAGE_VERSION <<
 #endif
-            " " << identifier;
-        edi_output.set_odr_version_tag(ss.str());
+                " " << identifier;
+            service.edi_output.set_odr_version_tag(ss.str());
+        }
+
+        service.decoder.set_interval(decode_interval);
+        service.edi_output.set_audio_levels_enabled(service.decoder.enabled());
+        service.monitor.set_config(monitor_config, service.stream);
+
+        if (not pcm_tap_name.empty() and service.decoder.enabled()) {
+            string name = pcm_tap_name;
+            if (service.stream != 0) {
+                name += "-" + to_string(service.stream);
+            }
+
+            try {
+                service.decoder.set_pcm_tap(make_shared<PCMTap>(name, PCM_TAP_NUM_SLOTS));
+            }
+            catch (const runtime_error& e) {
+                fprintf(stderr, "Failed to set up the PCM tap: %s\n", e.what());
+                return 1;
+            }
+        }
+    }
+
+    if (show_level and decode_interval == 0) {
+        fprintf(stderr, "Warning: no audio levels to show with --decode-interval=0\n");
+    }
+
+    if (not pcm_tap_name.empty() and decode_interval != 1) {
+        fprintf(stderr, "Warning: the PCM tap only carries the decoded superframes, "
+                "see --decode-interval\n");
     }
 
     if (padlen != 0 and not pad_ident.empty()) {
@@ -389,11 +585,13 @@ int main(int argc, char *argv[])
         fprintf(stderr, "PAD socket opened\n");
     }
 
-    AVTInput avtinput(avt_input_uri, avt_output_uri, avt_pad_port, avt_jitterBufferSize);
+    AVTInput avtinput(avt_input_uris, avt_output_uri, avt_pad_port,
+            avt_jitterBufferSize, avt_gapWaitMs, avt_jitterBufferMinSize);
 
-    if (avt_input_uri != "") {
+    if (not avt_input_uris.empty()) {
         if (avtinput.prepare() != 0) {
-            fprintf(stderr, "Fail to connect to AVT encoder in:'%s' out:'%s'\n", avt_input_uri.c_str(), avt_output_uri.c_str());
+            fprintf(stderr, "Fail to connect to AVT encoder in:'%s' out:'%s'\n",
+                    avt_input_uris[0].c_str(), avt_output_uri.c_str());
             return 1;
         }
 
@@ -402,6 +600,10 @@ int main(int argc, char *argv[])
             fprintf(stderr, "Wrong audio parameters for AVT encoder\n");
             return 1;
         }
+
+        for (const auto& service : services) {
+            avtinput.addStream(service.stream);
+        }
     }
     else {
         fprintf(stderr, "No input defined\n");
@@ -423,11 +625,7 @@ int main(int argc, char *argv[])
         }
     }
 
-    int outbuf_size;
-    std::vector<uint8_t> outbuf;
-
-    outbuf_size = bitrate/8*120;
-    outbuf.resize(24*120);
+    const int outbuf_size = bitrate/8*120;
 
     if (outbuf_size % 5 != 0) {
         fprintf(stderr, "Warning: (outbuf_size mod 5) = %d\n", outbuf_size % 5);
@@ -441,19 +639,29 @@ int main(int argc, char *argv[])
     int peak_left = 0;
     int peak_right = 0;
 
-    ssize_t read_bytes = 0;
+    // The input sockets don't change, only the PAD socket gets appended
+    // to them when needed
+    std::vector<struct pollfd> poll_fds;
+    for (int fd : avtinput.getNativeSockets()) {
+        poll_fds.push_back({fd, POLLIN, 0});
+    }
+    const size_t num_input_fds = poll_fds.size();
+    poll_fds.reserve(num_input_fds + 1);
+
+    bool got_frame = false;
     do {
-        size_t numOutBytes = 0;
-        read_bytes = 0;
+        got_frame = false;
 
         // -------------- Read Data
-        memset(&outbuf[0], 0x00, outbuf_size);
+        for (auto& service : services) {
+            service.numOutBytes = 0;
+        }
 
         const auto timeout_start = std::chrono::steady_clock::now();
         const auto timeout_duration = std::chrono::milliseconds(avt_timeout);
         bool timedout = false;
 
-        while (!timedout and numOutBytes == 0) {
+        while (!timedout and not got_frame) {
             // Fill the PAD Frame queue because multiple PAD frame requests
             // can come for each DAB+ Frames (up to 6),
             if (padlen != 0) {
@@ -474,14 +682,17 @@ int main(int argc, char *argv[])
                 }
             }
 
-            chrono::system_clock::time_point ts;
-            numOutBytes = avtinput.getNextFrame(outbuf, ts);
-            if (numOutBytes > 0) {
-                if (not edi_output_uris.empty()) {
-                    edi_output.set_tist(tist_enabled, tist_delay_ms, ts);
+            for (auto& service : services) {
+                service.numOutBytes = avtinput.getNextFrame(service.stream, service.outbuf, service.ts);
+                if (service.numOutBytes > 0) {
+                    got_frame = true;
+                    if (not service.edi_output_uris.empty()) {
+                        service.edi_output.set_tist(tist_enabled, tist_delay_ms, service.ts);
+                    }
                 }
             }
-            else {
+
+            if (not got_frame) {
                 const auto curTime = std::chrono::steady_clock::now();
                 const auto diff = curTime - timeout_start;
                 if (diff > timeout_duration) {
@@ -489,47 +700,129 @@ int main(int argc, char *argv[])
                     timedout = true;
                 }
                 else {
-                    const int wait_ms = 1;
-                    usleep(wait_ms * 1000);
+                    // Sleep until the encoder or ODR-PadEnc sends something, or until
+                    // the timeout expires. The PadEnc socket is only watched when we
+                    // can accept PAD data, otherwise a pending reply would wake us
+                    // up continuously.
+                    poll_fds.resize(num_input_fds);
+
+                    if (padlen != 0 and not avtinput.padQueueFull()) {
+                        poll_fds.push_back({pad_intf.get_sockfd(), POLLIN, 0});
+                    }
+
+                    auto wait_ms = chrono::ceil<chrono::milliseconds>(timeout_duration - diff);
+
+                    // A frame is missing in the jitter buffer, wake up when it is
+                    // to be skipped.
+                    chrono::system_clock::time_point gap_deadline;
+                    if (avtinput.gapDeadline(gap_deadline)) {
+                        const auto gap_ms = chrono::ceil<chrono::milliseconds>(
+                                gap_deadline - chrono::system_clock::now());
+                        wait_ms = std::max(chrono::milliseconds(0), std::min(wait_ms, gap_ms));
+                    }
+
+                    if (poll(poll_fds.data(), poll_fds.size(), wait_ms.count()) == -1 and errno != EINTR) {
+                        fprintf(stderr, "Waiting for input failed: %s\n", strerror(errno));
+                        timedout = true;
+                    }
                 }
             }
         }
 
-        if (numOutBytes != 0) {
-            try {
-                if (numOutBytes % 120 != 0) {
-                    throw runtime_error("Invalid data length " + to_string(numOutBytes));
+        for (auto& service : services) {
+            const size_t numOutBytes = service.numOutBytes;
+            if (numOutBytes == 0) {
+                continue;
+            }
+
+            if (numOutBytes % 120 != 0) {
+                fprintf(stderr, "AAC decoding failed with: Invalid data length %zu\n", numOutBytes);
+            }
+            else {
+                if (rs_correct) {
+                    const auto r = service.rs.correct(service.outbuf.data(), numOutBytes);
+                    service.rs_corrected += r.corrected;
+                    service.rs_uncorrectable += r.uncorrectable;
                 }
 
                 // Drop the Reed-Solomon data
-                decoder.decode_frame(outbuf.data(), numOutBytes / 120 * 110);
+                const size_t len = numOutBytes / 120 * 110;
 
-                auto p = decoder.get_peaks();
-                peak_left = p.peak_left;
-                peak_right = p.peak_right;
-            }
-            catch (const runtime_error &e) {
-                fprintf(stderr, "AAC decoding failed with: %s\n", e.what());
-                peak_left = 0;
-                peak_right = 0;
+                // Only decode the AUs that are intact
+                const auto c = service.check.check(service.outbuf.data(), len);
+                if (c.header_ok) {
+                    service.au_errors += c.au_errors;
+                    service.decoder.push_frame(service.outbuf.data(), len, c.au_valid, service.ts);
+                }
+                else {
+                    service.header_errors++;
+                }
             }
 
-            if (stats_publisher) {
-                stats_publisher->update_audio_levels(peak_left, peak_right);
-            }
-        }
+            // The outputs carry the levels of the latest decoded superframe,
+            // the decoder thread usually is one superframe behind.
+            const auto levels = service.decoder.get_levels();
+            const int service_peak_left = levels.peaks.peak_left;
+            const int service_peak_right = levels.peaks.peak_right;
+
+            service.monitor.process(service.outbuf.data(), numOutBytes,
+                    levels.peaks.peak_left, levels.peaks.peak_right,
+                    service.decoder.enabled());
+
+            // Levels and stats are about stream 0
+            if (&service == &services.front()) {
+                peak_left = service_peak_left;
+                peak_right = service_peak_right;
+
+                if (stats_publisher) {
+                    stats_publisher->update_audio_levels(peak_left, peak_right);
+                    stats_publisher->update_audio_rms(levels.peaks.rms_left, levels.peaks.rms_right);
+                    stats_publisher->update_loudness(levels.loudness.momentary,
+                            levels.loudness.shortterm, levels.loudness.integrated);
+                    stats_publisher->update_superframe_errors(
+                            service.header_errors, service.au_errors);
+                    if (rs_correct) {
+                        stats_publisher->update_reed_solomon(
+                                service.rs_corrected, service.rs_uncorrectable);
+                    }
+                    stats_publisher->update_decoder(levels.age, levels.num_dropped, levels.cpu_time);
+                    stats_publisher->update_decoder_errors(levels.errors.invalid_header,
+                            levels.errors.config_failed, levels.errors.fill_failed,
+                            levels.errors.decode_failed, levels.errors.concealed);
+                    stats_publisher->update_decoder_config(levels.config.num_reconfigurations,
+                            levels.config.config_time_ms);
+
+                    const auto& m = service.monitor.get_state();
+                    stats_publisher->update_audio_monitor(m.silence, m.silence_s,
+                            m.stuck, m.stuck_frames, m.num_events);
+
+                    edi::Sender::spreading_stats_t spreading;
+                    if (service.edi_output.get_spreading_stats(spreading)) {
+                        stats_publisher->update_edi_spreading(spreading.num_sent,
+                                edi::Sender::lateness_bins_us.data(),
+                                spreading.lateness_histogram.data(),
+                                edi::Sender::lateness_bins_us.size());
+                    }
 
-        read_bytes = numOutBytes;
+                    const auto jb = avtinput.getJitterBufferStats(service.stream);
+                    stats_publisher->update_jitter_buffer(jb.size, jb.target, jb.jitter_ms);
+
+                    for (size_t i = 0; i < avtinput.getNumInputPaths(); i++) {
+                        const auto& path = avtinput.getInputPathStats(i);
+                        stats_publisher->update_input_path(i, path.received,
+                                path.lost, path.late, path.duplicates);
+                    }
+                }
+            }
 
-        if (numOutBytes != 0) {
             bool success = true;
-            if (zmq_output) {
-                zmq_output->update_audio_levels(peak_left, peak_right);
-                success &= zmq_output->write_frame(outbuf.data(), numOutBytes);
+            if (service.zmq_output) {
+                service.zmq_output->update_audio_levels(service_peak_left, service_peak_right);
+                success &= service.zmq_output->write_frame(service.outbuf.data(), numOutBytes);
             }
 
-            if (edi_output.enabled()) {
-                edi_output.update_audio_levels(peak_left, peak_right);
+            if (service.edi_output.enabled()) {
+                service.edi_output.update_audio_levels(service_peak_left, service_peak_right);
                 // STI/EDI specifies that one AF packet must contain 24ms worth of data,
                 // therefore we must split the superframe into five parts
                 if (numOutBytes % 5 != 0) {
@@ -538,7 +831,7 @@ int main(int argc, char *argv[])
 
                 const size_t blocksize = numOutBytes/5;
                 for (size_t i = 0; i < 5; i++) {
-                    success &= edi_output.write_frame(outbuf.data() + i * blocksize, blocksize);
+                    success &= service.edi_output.write_frame(service.outbuf.data() + i * blocksize, blocksize);
                     if (not success) {
                         break;
                     }
@@ -556,7 +849,11 @@ int main(int argc, char *argv[])
             }
         }
 
-        if (numOutBytes != 0) {
+        if (retval != 0) {
+            break;
+        }
+
+        if (services.front().numOutBytes != 0) {
             if (show_level) {
                 if (channels == 1) {
                     fprintf(stderr, "\rIn: [%-6s]",
@@ -576,7 +873,7 @@ int main(int argc, char *argv[])
                 stats_publisher->send_stats();
             }
         }
-    } while (read_bytes > 0);
+    } while (got_frame);
 
     fprintf(stderr, "\n");
 
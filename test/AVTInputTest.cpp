@@ -0,0 +1,88 @@
+/* ------------------------------------------------------------------
+ * Copyright (C) 2019 Matthias P. Braendli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ * -------------------------------------------------------------------
+ */
+
+/* Feeds STI packets with valid and invalid stream lengths to an AVTInput
+ * over the loopback interface. */
+
+#include "Test.h"
+#include "AVTInput.h"
+#include <vector>
+
+static const int PORT = 39017;
+
+struct stc_t {
+    uint16_t stl;
+    bool crc;
+};
+
+// An STI packet carrying the given streams, filled with zeros
+static std::vector<uint8_t> make_sti(uint16_t frame_number, const std::vector<stc_t>& streams)
+{
+    std::vector<uint8_t> pkt = { 0x00, 0x1F, 0x90, 0xCA }; // ERR, FSYNC
+    pkt.insert(pkt.end(), 4, 0); // DFS, CFS
+    pkt.insert(pkt.end(), 5, 0); // FC up to DFCTL
+    pkt.push_back(frame_number % 250); // DFCTL
+    const uint16_t nst = streams.size();
+    pkt.push_back(((frame_number / 250) << 3) | (nst >> 8)); // DFCTH, NST
+    pkt.push_back(nst & 0xFF);
+
+    size_t data_len = 0;
+    for (const auto& s : streams) {
+        pkt.push_back(s.stl >> 8);
+        pkt.push_back(s.stl & 0xFF);
+        pkt.push_back(0);
+        // The lowest bit is set, so that a parser looking at the wrong
+        // bit gets the CRC flag wrong
+        pkt.push_back(s.crc ? 0x81 : 0x01);
+        data_len += s.stl;
+    }
+    pkt.insert(pkt.end(), 4, 0); // EOH
+    pkt.insert(pkt.end(), data_len, 0);
+    return pkt;
+}
+
+TEST(invalid_stream_length)
+{
+    AVTInput input({"udp://:" + std::to_string(PORT)}, "", 0);
+    input.addStream(1);
+    CHECK(input.prepare() == 0);
+
+    Socket::UDPSocket sender;
+    Socket::InetAddress dest;
+    dest.resolveUdpDestination("127.0.0.1", PORT);
+
+    const uint16_t stream0_stl = DEF_BR * 3;
+    std::vector<uint8_t> buf;
+    std::chrono::system_clock::time_point ts;
+
+    // Stream 1 without any data, or shorter than its CRC
+    uint16_t frame_number = 0;
+    for (const auto& bad : std::vector<stc_t>{ {0, false}, {0, true}, {1, true}, {2, true} }) {
+        sender.send(make_sti(frame_number++, { {stream0_stl, false}, bad }), dest);
+        input.getNextFrame(0, buf, ts);
+        CHECK(input.getJitterBufferStats(1).size == 0);
+    }
+
+    // Stream 0 is still received
+    CHECK(input.getInputPathStats(0).received == 4);
+
+    // A valid stream 1, whose CRC is not part of the frame
+    sender.send(make_sti(frame_number++, { {stream0_stl, false}, {10, true} }), dest);
+    input.getNextFrame(0, buf, ts);
+    CHECK(input.getJitterBufferStats(1).size == 1);
+}
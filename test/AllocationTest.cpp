@@ -0,0 +1,98 @@
+/* ------------------------------------------------------------------
+ * Copyright (C) 2019 Matthias P. Braendli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ * -------------------------------------------------------------------
+ */
+
+/* Counts the heap allocations AVTInput makes while it receives frames
+ * and hands superframes over, once it has reached steady state. */
+
+#include "Test.h"
+#include "AVTInput.h"
+#include <new>
+#include <vector>
+
+static size_t num_allocations = 0;
+
+void* operator new(size_t size)
+{
+    num_allocations++;
+    void *p = malloc(size ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+static const int PORT = 39018;
+static const size_t WARMUP_FRAMES = 100;
+static const size_t COUNTED_FRAMES = 500;
+
+TEST(steady_state_receive)
+{
+    AVTInput input({"udp://:" + std::to_string(PORT)}, "", 0, 2);
+    CHECK(input.prepare() == 0);
+
+    Socket::UDPSocket sender;
+    Socket::InetAddress dest;
+    dest.resolveUdpDestination("127.0.0.1", PORT);
+
+    // One STI packet with stream 0, its frame number gets updated in place
+    const size_t stl = DEF_BR * 3;
+    std::vector<uint8_t> pkt = { 0x00, 0x1F, 0x90, 0xCA }; // ERR, FSYNC
+    pkt.insert(pkt.end(), 9, 0);  // DFS, CFS, FC up to DFCTL
+    pkt.insert(pkt.end(), { 0x00, 0x00, 0x01 }); // DFCTL, DFCTH and NST = 1
+    pkt.insert(pkt.end(), { stl >> 8, stl & 0xFF, 0x00, 0x00 }); // STC
+    pkt.insert(pkt.end(), 4, 0); // EOH
+    pkt.insert(pkt.end(), stl, 0);
+    const size_t dfctl_index = 13;
+
+    std::vector<uint8_t> buf;
+    std::chrono::system_clock::time_point ts;
+
+    size_t num_superframes = 0;
+    size_t allocations_before = 0;
+    for (size_t i = 0; i < WARMUP_FRAMES + COUNTED_FRAMES; i++) {
+        if (i == WARMUP_FRAMES) {
+            allocations_before = num_allocations;
+            num_superframes = 0;
+        }
+
+        const size_t frame_number = i % MAX_QUEUE_SIZE;
+        pkt[dfctl_index] = frame_number % 250;
+        pkt[dfctl_index + 1] = (frame_number / 250) << 3;
+        sender.send(pkt, dest);
+
+        if (input.getNextFrame(buf, ts) > 0) {
+            num_superframes++;
+        }
+    }
+
+    const size_t allocations = num_allocations - allocations_before;
+    fprintf(stderr, "%zu superframes, %zu allocations\n", num_superframes, allocations);
+
+    CHECK(num_superframes >= COUNTED_FRAMES / 5 - 1);
+    CHECK(allocations == 0);
+}
@@ -0,0 +1,142 @@
+/* ------------------------------------------------------------------
+ * Copyright (C) 2019 Matthias P. Braendli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ * -------------------------------------------------------------------
+ */
+
+/* Decodes a file of DAB+ superframes with decode intervals 1, N and 0,
+ * the way odr-sourcecompanion does with --decode-interval, and reports
+ * the CPU time the decoder thread of each service used.
+ *
+ * The file contains superframes including their Reed-Solomon data, as
+ * written by odr-audioenc to a .dabp file. This is not run by make check,
+ * as the result depends on the machine. */
+
+#include "AACDecoder.h"
+#include "SuperframeCheck.h"
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Duration of one superframe, in seconds
+static const double SUPERFRAME_DURATION = 0.120;
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s FILE BITRATE [INTERVAL [NUM_SERVICES]]\n"
+            "  FILE          superframes with Reed-Solomon data\n"
+            "  BITRATE       of the superframes, in kbps\n"
+            "  INTERVAL      decode interval to compare with 1 and 0 (def=4)\n"
+            "  NUM_SERVICES  number of services decoding the file in parallel (def=1)\n",
+            name);
+}
+
+static void run(const std::vector<uint8_t>& superframes, size_t superframe_size,
+        unsigned int interval, size_t num_services)
+{
+    std::vector<std::unique_ptr<AACDecoderThread> > decoders;
+    for (size_t s = 0; s < num_services; s++) {
+        decoders.emplace_back(new AACDecoderThread());
+        decoders.back()->set_interval(interval);
+    }
+
+    SuperframeCheck check;
+
+    // Drop the Reed-Solomon data
+    const size_t len = superframe_size / 120 * 110;
+
+    uint64_t num_pushed = 0;
+    uint64_t header_errors = 0;
+    for (size_t offset = 0; offset + superframe_size <= superframes.size();
+            offset += superframe_size) {
+        const uint8_t *data = superframes.data() + offset;
+
+        const auto c = check.check(data, len);
+        if (not c.header_ok) {
+            header_errors++;
+            continue;
+        }
+
+        for (auto& decoder : decoders) {
+            decoder->push_frame(data, len, c.au_valid);
+        }
+        num_pushed++;
+
+        // Let the decoders catch up, so that no superframe gets dropped
+        if (interval > 0 and num_pushed % interval == 0) {
+            for (auto& decoder : decoders) {
+                while (decoder->get_levels().age > 0) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+            }
+        }
+    }
+
+    const double duration = num_pushed * SUPERFRAME_DURATION;
+
+    printf("--decode-interval=%u, %llu superframes, %llu header errors\n", interval,
+            (unsigned long long)num_pushed, (unsigned long long)header_errors);
+    for (size_t s = 0; s < num_services; s++) {
+        const auto levels = decoders[s]->get_levels();
+        printf("  service %zu: %.3f s CPU, %.2f%% of real time, %llu dropped\n",
+                s, levels.cpu_time,
+                duration > 0 ? 100.0 * levels.cpu_time / duration : 0.0,
+                (unsigned long long)levels.num_dropped);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3 or argc > 5) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const int bitrate = atoi(argv[2]);
+    const int interval = argc > 3 ? atoi(argv[3]) : 4;
+    const int num_services = argc > 4 ? atoi(argv[4]) : 1;
+    if (bitrate <= 0 or bitrate % 8 != 0 or interval < 1 or num_services < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE *fd = fopen(argv[1], "rb");
+    if (fd == nullptr) {
+        perror("Could not open superframe file");
+        return 1;
+    }
+
+    std::vector<uint8_t> superframes;
+    uint8_t buf[4096];
+    size_t r;
+    while ((r = fread(buf, 1, sizeof(buf), fd)) > 0) {
+        superframes.insert(superframes.end(), buf, buf + r);
+    }
+    fclose(fd);
+
+    const size_t superframe_size = bitrate / 8 * 120;
+    if (superframes.size() < superframe_size) {
+        fprintf(stderr, "File does not contain a whole superframe\n");
+        return 1;
+    }
+
+    for (unsigned int i : {1u, (unsigned int)interval, 0u}) {
+        run(superframes, superframe_size, i, num_services);
+    }
+
+    return 0;
+}
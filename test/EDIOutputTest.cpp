@@ -0,0 +1,242 @@
+/* ------------------------------------------------------------------
+ * Copyright (C) 2019 Matthias P. Braendli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ * -------------------------------------------------------------------
+ */
+
+/* Serialises TAG packets containing every tag type, and compares the
+ * AF packets against the output of the implementation that built a new
+ * vector for every tag item. */
+
+#include "Test.h"
+#include "edioutput/AFPacket.h"
+#include "edioutput/TagItems.h"
+#include "edioutput/TagPacket.h"
+#include <string>
+#include <vector>
+
+using namespace edi;
+
+static const unsigned ALIGNMENTS[] = { 0, 8, 16 };
+static const int NUM_VARIANTS = 3;
+
+/* AF packets with sequence numbers 0 to 8, for every alignment and
+ * variant in order, as assembled before the tag items wrote into a
+ * shared buffer. */
+static const char * const EXPECTED_AF_PACKETS[] = {
+    "4146000000ae000090542a707472000000404453544900000000646574690000"
+    "00b0c064ffc01234050012d687abcdef000306090c0f12156573740400000098"
+    "0c6414000306090c0f1215181b1e2124272a2d647374690000001000c8737301"
+    "02000000d8014005000306090c0f1215181b1e2124272a2d303336393c3f4245"
+    "2a646d79000000004f445276000000e04f44522d536f75726365436f6d70616e"
+    "696f6e20746573740000002a4f44526100000020fb2e10e1566c",
+
+    "4146000000b3000190542a707472000000404453544900000000646574690000"
+    "00708065ffc81234050012d688abcdef65737404000000980c64140104070a0d"
+    "101316191c1f2225282b2e6473746900000068c0c90f1234050074cbb2123456"
+    "73730102000000d00150050104070a0d101316191c1f2225282b2e3134373a3d"
+    "40432a646d79000000180000004f445276000000e04f44522d536f7572636543"
+    "6f6d70616e696f6e20746573740000002b4f44526100000020fb2e10e2762e",
+
+    "4146000000be000290542a707472000000404453544900000000646574690000"
+    "00c8e066ffd01234050012d689abcdef0205080b0e1114171234566573740400"
+    "0000980c64140205080b0e1114171a1d202326292c2f647374690000005820ca"
+    "07070707070707070773730102000000c80140050205080b0e1114171a1d2023"
+    "26292c2f3235383b3e412a646d79000000300000000000004f445276000000e0"
+    "4f44522d536f75726365436f6d70616e696f6e20746573740000002c4f445261"
+    "00000020fb2e10e34c64",
+
+    "4146000000b0000390542a707472000000404453544900000000646574690000"
+    "00b0c064ffc01234050012d687abcdef000306090c0f12156573740400000098"
+    "0c6414000306090c0f1215181b1e2124272a2d647374690000001000c8737301"
+    "02000000d8014005000306090c0f1215181b1e2124272a2d303336393c3f4245"
+    "2a646d79000000004f445276000000e04f44522d536f75726365436f6d70616e"
+    "696f6e20746573740000002a4f44526100000020fb2e10e10000bd7e",
+
+    "4146000000b8000490542a707472000000404453544900000000646574690000"
+    "00708065ffc81234050012d688abcdef65737404000000980c64140104070a0d"
+    "101316191c1f2225282b2e6473746900000068c0c90f1234050074cbb2123456"
+    "73730102000000d00150050104070a0d101316191c1f2225282b2e3134373a3d"
+    "40432a646d79000000180000004f445276000000e04f44522d536f7572636543"
+    "6f6d70616e696f6e20746573740000002b4f44526100000020fb2e10e2000000"
+    "0000ec45",
+
+    "4146000000c0000590542a707472000000404453544900000000646574690000"
+    "00c8e066ffd01234050012d689abcdef0205080b0e1114171234566573740400"
+    "0000980c64140205080b0e1114171a1d202326292c2f647374690000005820ca"
+    "07070707070707070773730102000000c80140050205080b0e1114171a1d2023"
+    "26292c2f3235383b3e412a646d79000000300000000000004f445276000000e0"
+    "4f44522d536f75726365436f6d70616e696f6e20746573740000002c4f445261"
+    "00000020fb2e10e300005f1a",
+
+    "4146000000be000690542a707472000000404453544900000000646574690000"
+    "00b0c064ffc01234050012d687abcdef000306090c0f12156573740400000098"
+    "0c6414000306090c0f1215181b1e2124272a2d647374690000001000c8737301"
+    "02000000d8014005000306090c0f1215181b1e2124272a2d303336393c3f4245"
+    "2a646d79000000004f445276000000e04f44522d536f75726365436f6d70616e"
+    "696f6e20746573740000002a4f44526100000020fb2e10e12a646d7900000040"
+    "0000000000000000c6a9",
+
+    "4146000000c3000790542a707472000000404453544900000000646574690000"
+    "00708065ffc81234050012d688abcdef65737404000000980c64140104070a0d"
+    "101316191c1f2225282b2e6473746900000068c0c90f1234050074cbb2123456"
+    "73730102000000d00150050104070a0d101316191c1f2225282b2e3134373a3d"
+    "40432a646d79000000180000004f445276000000e04f44522d536f7572636543"
+    "6f6d70616e696f6e20746573740000002b4f44526100000020fb2e10e22a646d"
+    "790000004000000000000000008b61",
+
+    "4146000000ce000890542a707472000000404453544900000000646574690000"
+    "00c8e066ffd01234050012d689abcdef0205080b0e1114171234566573740400"
+    "0000980c64140205080b0e1114171a1d202326292c2f647374690000005820ca"
+    "07070707070707070773730102000000c80140050205080b0e1114171a1d2023"
+    "26292c2f3235383b3e412a646d79000000300000000000004f445276000000e0"
+    "4f44522d536f75726365436f6d70616e696f6e20746573740000002c4f445261"
+    "00000020fb2e10e32a646d79000000400000000000000000539a",
+};
+
+// One of each tag item, with contents depending on variant
+struct all_tags_t {
+    all_tags_t(int variant) :
+        ptr("DSTI"),
+        dmy(variant * 3),
+        version("ODR-SourceCompanion test", 42 + variant),
+        levels(-1234, 4321 + variant)
+    {
+        for (size_t i = 0; i < sizeof(data); i++) {
+            data[i] = i * 3 + variant;
+        }
+
+        deti.stat = 0xFF;
+        deti.mid = 3;
+        deti.fp = variant;
+        deti.mnsc = 0x1234;
+        deti.dlfc = 100 + variant;
+        deti.atstf = true;
+        deti.utco = 5;
+        deti.seconds = 1234567 + variant;
+        deti.tsta = 0xabcdef;
+        deti.ficf = variant != 1;
+        deti.fic_data = data;
+        deti.fic_length = 8;
+        deti.rfudf = variant == 2;
+        deti.rfud = 0x123456;
+
+        estn.scid = 3;
+        estn.sad = 100;
+        estn.tpl = 5;
+        estn.rfa = 0;
+        estn.mst_data = data;
+        estn.mst_length = 2;
+        estn.id = 4;
+
+        dsti.stihf = variant == 1;
+        dsti.atstf = variant & 1;
+        dsti.rfadf = variant == 2;
+        dsti.dlfc = 200 + variant;
+        dsti.stat = 0x0F;
+        dsti.spid = 0x1234;
+        dsti.utco = 5;
+        dsti.seconds = 7654321 + variant;
+        dsti.tsta = 0x123456;
+        dsti.rfad.fill(7);
+
+        ssm.tid = 1;
+        ssm.tidext = 2;
+        ssm.crcstf = variant == 1;
+        ssm.stid = 5;
+        ssm.istd_data = data;
+        ssm.istd_length = sizeof(data) - variant;
+        ssm.id = 0x0102;
+    }
+
+    TagPacket packet(unsigned alignment)
+    {
+        TagPacket tp(alignment);
+        tp.tag_items = { &ptr, &deti, &estn, &dsti, &ssm, &dmy,
+            &version, &levels };
+        return tp;
+    }
+
+    uint8_t data[24];
+    TagStarPTR ptr;
+    TagDETI deti;
+    TagESTn estn;
+    TagDSTI dsti;
+    TagSSm ssm;
+    TagStarDMY dmy;
+    TagODRVersion version;
+    TagODRAudioLevels levels;
+};
+
+static std::string to_hex(const std::vector<uint8_t>& buf)
+{
+    std::string hex;
+    for (uint8_t b : buf) {
+        char digits[3];
+        snprintf(digits, sizeof(digits), "%02x", b);
+        hex += digits;
+    }
+    return hex;
+}
+
+TEST(tag_packet_assemble_into)
+{
+    std::vector<uint8_t> buf;
+    for (unsigned alignment : ALIGNMENTS) {
+        for (int variant = 0; variant < NUM_VARIANTS; variant++) {
+            // TagDETI counts frames, each packet needs its own tags
+            all_tags_t tags(variant), tags_into(variant);
+            const auto expected = tags.packet(alignment).Assemble();
+            if (alignment == 8) {
+                CHECK(expected.size() % 8 == 0);
+            }
+
+            // The packet is appended after what buf already contains, an
+            // odd number of bytes so that padding must not depend on it
+            const std::vector<uint8_t> prefix(variant * 2 + 1, 0xAA);
+            buf = prefix;
+            tags_into.packet(alignment).AssembleInto(buf);
+            CHECK(std::vector<uint8_t>(buf.begin(), buf.begin() + prefix.size()) == prefix);
+            CHECK(std::vector<uint8_t>(buf.begin() + prefix.size(), buf.end()) == expected);
+        }
+    }
+}
+
+TEST(af_packet_matches_previous_output)
+{
+    AFPacketiser afp;
+    size_t i = 0;
+    for (unsigned alignment : ALIGNMENTS) {
+        for (int variant = 0; variant < NUM_VARIANTS; variant++) {
+            all_tags_t tags(variant);
+            CHECK(to_hex(afp.Assemble(tags.packet(alignment))) ==
+                    EXPECTED_AF_PACKETS[i++]);
+        }
+    }
+}
+
+TEST(af_packet_reused)
+{
+    AFPacketiser afp;
+    AFPacket af;
+    size_t i = 0;
+    for (unsigned alignment : ALIGNMENTS) {
+        for (int variant = 0; variant < NUM_VARIANTS; variant++) {
+            all_tags_t tags(variant);
+            afp.Assemble(tags.packet(alignment), af);
+            CHECK(to_hex(af) == EXPECTED_AF_PACKETS[i++]);
+        }
+    }
+}
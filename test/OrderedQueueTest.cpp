@@ -0,0 +1,313 @@
+/* ------------------------------------------------------------------
+ * Copyright (C) 2019 Matthias P. Braendli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ * -------------------------------------------------------------------
+ */
+
+/* Checks the capacity limits of the OrderedQueue constructor, which main()
+ * checks the --jitter-size option against, and the order in which pushed
+ * frames come out. */
+
+#include "Test.h"
+#include "OrderedQueue.h"
+#include "AVTInput.h"
+#include <stdexcept>
+
+using Result = OrderedQueue::PushResult;
+
+static const int32_t MAX_INDEX = 5000;
+
+// Frames carry the low byte of their index
+static Result push(OrderedQueue& queue, int32_t index,
+        const timestamp_t& ts = timestamp_t())
+{
+    const uint8_t data = index;
+    return queue.push(index, &data, 1, ts);
+}
+
+// Return the index of the popped frame, or -1 if none
+static int32_t pop(OrderedQueue& queue)
+{
+    int32_t index = -1;
+    const auto frame = queue.pop(&index);
+    if (frame == nullptr) {
+        return -1;
+    }
+    CHECK(frame->buf.size() == 1 and frame->buf[0] == (uint8_t)index);
+    return index;
+}
+
+static bool constructs(int32_t maxIndex, size_t capacity)
+{
+    try {
+        OrderedQueue queue(maxIndex, capacity, 10);
+        return true;
+    }
+    catch (const std::invalid_argument&) {
+        return false;
+    }
+}
+
+TEST(capacity_limits)
+{
+    CHECK(not constructs(5000, 0));
+    CHECK(constructs(5000, 1));
+    CHECK(constructs(5000, 40));
+    CHECK(constructs(5000, 2499));
+    CHECK(not constructs(5000, 2500));
+    CHECK(not constructs(5000, 100000));
+
+    CHECK(constructs(MAX_QUEUE_SIZE, MAX_JITTER_BUFFER_SIZE));
+    CHECK(not constructs(MAX_QUEUE_SIZE, MAX_JITTER_BUFFER_SIZE + 1));
+}
+
+TEST(adaptive_capacity_limits)
+{
+    OrderedQueue queue(5000, 40);
+    queue.setAdaptiveCapacity(40, std::chrono::milliseconds(24));
+    CHECK_THROWS(queue.setAdaptiveCapacity(41, std::chrono::milliseconds(24)),
+            std::invalid_argument);
+}
+
+TEST(old_frame_into_empty_queue)
+{
+    OrderedQueue queue(MAX_INDEX, 5);
+    for (int32_t i = 0; i < 30; i++) {
+        CHECK(push(queue, i) == Result::Inserted);
+        CHECK(pop(queue) == i);
+    }
+
+    // A slower path delivers a frame that was already returned
+    CHECK(push(queue, 15) == Result::Duplicate);
+    CHECK(pop(queue) == -1);
+
+    // The stream continues where it was
+    CHECK(push(queue, 30) == Result::Inserted);
+    CHECK(pop(queue) == 30);
+}
+
+TEST(duplicate_and_late)
+{
+    OrderedQueue queue(MAX_INDEX, 3);
+    CHECK(push(queue, 0) == Result::Inserted);
+    CHECK(pop(queue) == 0);
+
+    // Frame 1 is missing, the full queue skips it
+    CHECK(push(queue, 2) == Result::Inserted);
+    CHECK(push(queue, 2) == Result::Duplicate);
+    CHECK(push(queue, 3) == Result::Inserted);
+    CHECK(push(queue, 4) == Result::Inserted);
+    CHECK(pop(queue) == 2);
+
+    CHECK(push(queue, 1) == Result::Late);
+    CHECK(push(queue, 0) == Result::Duplicate);
+    CHECK(push(queue, 2) == Result::Duplicate);
+    CHECK(push(queue, 3) == Result::Duplicate);
+    CHECK(pop(queue) == 3);
+    CHECK(pop(queue) == 4);
+}
+
+TEST(sender_restart)
+{
+    OrderedQueue queue(MAX_INDEX, 5);
+    for (int32_t i = 0; i < 1000; i++) {
+        CHECK(push(queue, i) == Result::Inserted);
+        CHECK(pop(queue) == i);
+    }
+
+    // Only frames behind arrive, the queue restarts from them once there
+    // were more than the size of the ring
+    int32_t index = 100;
+    while (push(queue, index) != Result::Inserted) {
+        CHECK(index < 100 + 11);
+        index++;
+    }
+    CHECK(pop(queue) == index);
+    CHECK(push(queue, index + 1) == Result::Inserted);
+    CHECK(pop(queue) == index + 1);
+}
+
+TEST(in_order)
+{
+    OrderedQueue queue(MAX_INDEX, 10);
+    CHECK(pop(queue) == -1);
+
+    for (int32_t i = 100; i < 110; i++) {
+        CHECK(push(queue, i) == Result::Inserted);
+    }
+    // Only the capacity is accepted
+    CHECK(push(queue, 110) == Result::Overrun);
+
+    for (int32_t i = 100; i < 110; i++) {
+        CHECK(pop(queue) == i);
+    }
+    CHECK(pop(queue) == -1);
+}
+
+TEST(reordered)
+{
+    OrderedQueue queue(MAX_INDEX, 10);
+    for (int32_t i : {0, 2, 1, 4, 3}) {
+        CHECK(push(queue, i) == Result::Inserted);
+    }
+    for (int32_t i = 0; i < 5; i++) {
+        CHECK(pop(queue) == i);
+    }
+}
+
+TEST(gap_skipped_when_full)
+{
+    OrderedQueue queue(MAX_INDEX, 4);
+    CHECK(push(queue, 0) == Result::Inserted);
+    CHECK(pop(queue) == 0);
+
+    // Frame 1 is missing, the queue waits until it is full
+    CHECK(push(queue, 2) == Result::Inserted);
+    CHECK(push(queue, 3) == Result::Inserted);
+    CHECK(push(queue, 4) == Result::Inserted);
+    CHECK(pop(queue) == -1);
+
+    CHECK(push(queue, 5) == Result::Inserted);
+    CHECK(pop(queue) == 2);
+    CHECK(pop(queue) == 3);
+    CHECK(pop(queue) == 4);
+    CHECK(pop(queue) == 5);
+}
+
+TEST(wraparound)
+{
+    OrderedQueue queue(MAX_INDEX, 4);
+    for (int32_t i = MAX_INDEX - 10; i < MAX_INDEX + 10; i++) {
+        CHECK(push(queue, i % MAX_INDEX) == Result::Inserted);
+        CHECK(pop(queue) == i % MAX_INDEX);
+    }
+
+    // A gap across the wraparound
+    CHECK(push(queue, 11) == Result::Inserted);
+    CHECK(push(queue, 12) == Result::Inserted);
+    CHECK(push(queue, 13) == Result::Inserted);
+    CHECK(push(queue, 14) == Result::Inserted);
+    CHECK(pop(queue) == 11);
+    CHECK(push(queue, 10) == Result::Late);
+    CHECK(push(queue, MAX_INDEX - 1) == Result::Duplicate);
+}
+
+TEST(large_capacity)
+{
+    // A frame far ahead is not mistaken for one behind
+    OrderedQueue queue(MAX_INDEX, 2000);
+    CHECK(push(queue, 0) == Result::Inserted);
+    CHECK(pop(queue) == 0);
+    CHECK(push(queue, 1500) == Result::Inserted);
+    CHECK(push(queue, 3000) == Result::Late);
+    CHECK(push(queue, 0) == Result::Duplicate);
+
+    OrderedQueue largest(MAX_QUEUE_SIZE, MAX_JITTER_BUFFER_SIZE);
+    CHECK(push(largest, 0) == Result::Inserted);
+    CHECK(pop(largest) == 0);
+    CHECK(push(largest, MAX_JITTER_BUFFER_SIZE) == Result::Inserted);
+}
+
+TEST(gap_deadline)
+{
+    using namespace std::chrono;
+    const auto now = system_clock::now();
+
+    OrderedQueue queue(MAX_INDEX, 10);
+    queue.setGapWait(milliseconds(50), milliseconds(24));
+    timestamp_t deadline;
+
+    CHECK(push(queue, 0, now) == Result::Inserted);
+    CHECK(not queue.gapDeadline(deadline));
+    CHECK(pop(queue) == 0);
+
+    // Frame 1 is missing, frame 2 was captured in the future
+    const auto ts = now + hours(1);
+    CHECK(push(queue, 2, ts) == Result::Inserted);
+    CHECK(queue.gapDeadline(deadline));
+    CHECK(deadline == ts - milliseconds(24) + milliseconds(50));
+    CHECK(pop(queue) == -1);
+
+    // Frame 4 is missing, frame 5 was captured long ago
+    OrderedQueue expired(MAX_INDEX, 10);
+    expired.setGapWait(milliseconds(50), milliseconds(24));
+    CHECK(push(expired, 3, now) == Result::Inserted);
+    CHECK(pop(expired) == 3);
+    CHECK(push(expired, 5, now - seconds(1)) == Result::Inserted);
+    CHECK(expired.gapDeadline(deadline));
+    CHECK(deadline < now);
+    CHECK(pop(expired) == 5);
+    CHECK(push(expired, 4, now) == Result::Late);
+
+    // Without gap wait, only a full queue skips gaps
+    OrderedQueue nowait(MAX_INDEX, 10);
+    CHECK(push(nowait, 0, now) == Result::Inserted);
+    CHECK(pop(nowait) == 0);
+    CHECK(push(nowait, 2, now - seconds(1)) == Result::Inserted);
+    CHECK(not nowait.gapDeadline(deadline));
+    CHECK(pop(nowait) == -1);
+}
+
+TEST(adaptive_target)
+{
+    using namespace std::chrono;
+    const auto frame = milliseconds(24);
+    const auto start = system_clock::now();
+
+    OrderedQueue queue(MAX_INDEX, 20);
+    queue.setAdaptiveCapacity(2, frame);
+    CHECK(queue.getStats().target == 2);
+
+    // Frames captured at a steady rate keep the minimum
+    int32_t index = 0;
+    for (; index < 100; index++) {
+        CHECK(push(queue, index, start + index * frame) == Result::Inserted);
+        CHECK(pop(queue) == index);
+    }
+    CHECK(queue.getStats().target == 2);
+
+    // Frames reordered by five grow the target immediately
+    CHECK(push(queue, index + 5, start + (index + 5) * frame) == Result::Inserted);
+    for (int32_t i = index; i < index + 5; i++) {
+        CHECK(push(queue, i, start + (index + 5) * frame) == Result::Inserted);
+    }
+    CHECK(queue.getStats().reorder_depth == 5);
+    CHECK(queue.getStats().target >= 6);
+    for (int32_t i = index; i <= index + 5; i++) {
+        CHECK(pop(queue) == i);
+    }
+    index += 6;
+
+    // and it shrinks back slowly once the reordering stops
+    const size_t grown = queue.getStats().target;
+    for (int end = index + 500; index < end; index++) {
+        CHECK(push(queue, index, start + index * frame) == Result::Inserted);
+        CHECK(pop(queue) == index);
+    }
+    CHECK(queue.getStats().target < grown);
+    CHECK(queue.getStats().target > 2);
+
+    for (int end = index + 5000; index < end; index++) {
+        CHECK(push(queue, index % MAX_INDEX, start + index * frame) == Result::Inserted);
+        CHECK(pop(queue) == index % MAX_INDEX);
+    }
+    CHECK(queue.getStats().target == 2);
+
+    // A gap is skipped once the queue holds the target
+    CHECK(push(queue, (index + 1) % MAX_INDEX, start + (index + 1) * frame) == Result::Inserted);
+    CHECK(pop(queue) == -1);
+    CHECK(push(queue, (index + 2) % MAX_INDEX, start + (index + 2) * frame) == Result::Inserted);
+    CHECK(pop(queue) == (index + 1) % MAX_INDEX);
+}
@@ -0,0 +1,50 @@
+/* ------------------------------------------------------------------
+ * Copyright (C) 2019 Matthias P. Braendli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ * -------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+/*! \file Test.h
+ *
+ * Minimal helpers for the programs run by make check. Every test program
+ * defines its test cases with TEST(), and is linked with TestMain.cpp,
+ * which runs them all. A failed CHECK() ends the program with an error.
+ */
+
+#define CHECK(cond) do { if (not (cond)) { \
+    fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    exit(1); } } while (0)
+
+/* Check that the statement throws an exception of the given type */
+#define CHECK_THROWS(statement, exception) do { \
+    bool thrown_ = false; \
+    try { statement; } \
+    catch (const exception&) { thrown_ = true; } \
+    CHECK(thrown_ && #statement " throws " #exception); } while (0)
+
+typedef void (*test_function_t)();
+
+/* Add a test case to the list TestMain.cpp runs, in the order of definition */
+bool register_test(const char *name, test_function_t function);
+
+#define TEST(name) \
+    static void test_##name(); \
+    static const bool test_##name##_registered = register_test(#name, test_##name); \
+    static void test_##name()
@@ -0,0 +1,47 @@
+/* ------------------------------------------------------------------
+ * Copyright (C) 2019 Matthias P. Braendli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ * -------------------------------------------------------------------
+ */
+
+#include "Test.h"
+#include <vector>
+#include <utility>
+
+using namespace std;
+
+// Constructed on first use, the tests register during static initialisation
+static vector<pair<const char*, test_function_t> >& tests()
+{
+    static vector<pair<const char*, test_function_t> > t;
+    return t;
+}
+
+bool register_test(const char *name, test_function_t function)
+{
+    tests().emplace_back(name, function);
+    return true;
+}
+
+int main()
+{
+    for (const auto& t : tests()) {
+        fprintf(stderr, "TEST %s\n", t.first);
+        t.second();
+    }
+
+    fprintf(stderr, "%zu tests passed\n", tests().size());
+    return 0;
+}